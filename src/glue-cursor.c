@@ -0,0 +1,218 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Reference counted cursor shapes, shared through a small LRU cache, the
+ * shape shown by a display, and the seqlock that publishes the cursor
+ * state to the host.
+ */
+
+#include <string.h>
+
+#include "glue-cursor.h"
+
+#define HASH_PRIME G_GUINT64_CONSTANT(0x9E3779B97F4A7C15)
+
+static uint32_t blank_pixel;
+static const GlueCursor blank_cursor = {
+    { 1, 1, 0, 0, &blank_pixel }, 0, GLUE_CURSOR_BLANK_ID, 1, 0
+};
+
+static guint64 hash_word(guint64 h, guint64 word)
+{
+    h = (h ^ word) * HASH_PRIME;
+    return h ^ (h >> 29);
+}
+
+static guint64 hash_cursor(uint32_t width, uint32_t height,
+			   uint32_t hot_x, uint32_t hot_y, const uint32_t *rgba)
+{
+    guint64 h = HASH_PRIME;
+    gsize i, n_pixels = (gsize)width * height;
+
+    h = hash_word(h, (guint64)width << 32 | height);
+    h = hash_word(h, (guint64)hot_x << 32 | hot_y);
+    for (i = 0; i + 2 <= n_pixels; i += 2) {
+	h = hash_word(h, (guint64)rgba[i] << 32 | rgba[i + 1]);
+    }
+    if (i < n_pixels)
+	h = hash_word(h, rgba[i]);
+    return h;
+}
+
+/* Ids are not reused, not even by the cache of another display, so a host
+ * cache keyed by them is never stale after a reconnection */
+static uint32_t new_cursor_id(void)
+{
+    static volatile gint last_id = GLUE_CURSOR_BLANK_ID;
+    uint32_t id;
+
+    do {
+	id = (uint32_t)g_atomic_int_add(&last_id, 1) + 1;
+    } while (id <= GLUE_CURSOR_BLANK_ID);
+    return id;
+}
+
+static gboolean cursor_equal(const GlueCursor *c, guint64 hash,
+			     uint32_t width, uint32_t height,
+			     uint32_t hot_x, uint32_t hot_y, const uint32_t *rgba)
+{
+    return c->hash == hash &&
+	c->cursor.width == width && c->cursor.height == height &&
+	c->cursor.hot_x == hot_x && c->cursor.hot_y == hot_y &&
+	memcmp(c->cursor.rgba, rgba, (gsize)width * height * 4) == 0;
+}
+
+void glue_cursor_cache_init(GlueCursorCache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+}
+
+void glue_cursor_cache_clear(GlueCursorCache *cache)
+{
+    int i;
+
+    for (i = 0; i < GLUE_CURSOR_CACHE_SIZE; i++) {
+	if (cache->entries[i] != NULL) {
+	    glue_cursor_unref(cache->entries[i]);
+	    cache->entries[i] = NULL;
+	}
+    }
+}
+
+GlueCursor *glue_cursor_cache_lookup(GlueCursorCache *cache,
+				     uint32_t width, uint32_t height,
+				     uint32_t hot_x, uint32_t hot_y,
+				     const uint32_t *rgba)
+{
+    guint64 hash = hash_cursor(width, height, hot_x, hot_y, rgba);
+    GlueCursor *c;
+    int i, slot = 0;
+
+    cache->lookups++;
+    for (i = 0; i < GLUE_CURSOR_CACHE_SIZE; i++) {
+	c = cache->entries[i];
+	if (c == NULL) {
+	    slot = i;
+	    continue;
+	}
+	if (cursor_equal(c, hash, width, height, hot_x, hot_y, rgba)) {
+	    c->last_used = cache->lookups;
+	    return glue_cursor_ref(c);
+	}
+	if (cache->entries[slot] != NULL && c->last_used < cache->entries[slot]->last_used)
+	    slot = i;
+    }
+
+    if (cache->entries[slot] != NULL)
+	glue_cursor_unref(cache->entries[slot]);
+
+    c = g_new(GlueCursor, 1);
+    c->cursor.width = width;
+    c->cursor.height = height;
+    c->cursor.hot_x = hot_x;
+    c->cursor.hot_y = hot_y;
+    c->cursor.rgba = g_memdup(rgba, width * height * 4);
+    c->hash = hash;
+    c->id = new_cursor_id();
+    c->ref_count = 1;
+    c->last_used = cache->lookups;
+    cache->entries[slot] = c;
+    return glue_cursor_ref(c);
+}
+
+GlueCursor *glue_cursor_ref(GlueCursor *cursor)
+{
+    cursor->ref_count++;
+    return cursor;
+}
+
+void glue_cursor_unref(GlueCursor *cursor)
+{
+    if (cursor == NULL || --cursor->ref_count > 0)
+	return;
+
+    g_free(cursor->cursor.rgba);
+    g_free(cursor);
+}
+
+const GlueCursor *glue_cursor_blank(void)
+{
+    return &blank_cursor;
+}
+
+void glue_cursor_view_init(GlueCursorView *view)
+{
+    view->shape = NULL;
+    view->visible = TRUE;
+    view->id = 0;
+}
+
+const GlueCursor *glue_cursor_view_get_shown(const GlueCursorView *view)
+{
+    return view->visible ? view->shape : &blank_cursor;
+}
+
+void glue_cursor_view_set_visible(GlueCursorView *view, gboolean visible)
+{
+    const GlueCursor *shown;
+
+    view->visible = visible;
+    shown = glue_cursor_view_get_shown(view);
+    view->id = shown != NULL ? shown->id : 0;
+}
+
+void glue_cursor_view_set_shape(GlueCursorView *view, GlueCursor *shape)
+{
+    glue_cursor_unref(view->shape);
+    view->shape = shape;
+    glue_cursor_view_set_visible(view, view->visible);
+}
+
+void glue_cursor_state_init(GlueCursorState *state)
+{
+    memset((void *)state, 0, sizeof(*state));
+    state->x = state->y = -1;
+}
+
+/* The atomic operations are full barriers, so the fields are written
+ * strictly between the two increments */
+void glue_cursor_state_publish(GlueCursorState *state, const MonoGlueCursorState *value)
+{
+    g_atomic_int_inc(&state->sequence);
+    g_atomic_int_set(&state->x, value->x);
+    g_atomic_int_set(&state->y, value->y);
+    g_atomic_int_set(&state->visible, value->visible);
+    g_atomic_int_set(&state->mouse_mode, value->mouse_mode);
+    g_atomic_int_set((volatile gint *)&state->cursor_id, value->cursor_id);
+    g_atomic_int_inc(&state->sequence);
+}
+
+void glue_cursor_state_read(GlueCursorState *state, MonoGlueCursorState *value)
+{
+    gint before, after;
+
+    do {
+	before = g_atomic_int_get(&state->sequence);
+	value->x = g_atomic_int_get(&state->x);
+	value->y = g_atomic_int_get(&state->y);
+	value->visible = g_atomic_int_get(&state->visible);
+	value->mouse_mode = g_atomic_int_get(&state->mouse_mode);
+	value->cursor_id = g_atomic_int_get((volatile gint *)&state->cursor_id);
+	after = g_atomic_int_get(&state->sequence);
+    } while ((before & 1) || before != after);
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_CURSOR_H_
+#define GLUE_CURSOR_H_
+
+#include <stdint.h>
+#include "glib.h"
+#include "mono-glue-types.h"
+
+/* Distinct cursor shapes kept by a display */
+#define GLUE_CURSOR_CACHE_SIZE 16
+
+/* Id of the shared blank cursor, never given to a cached shape */
+#define GLUE_CURSOR_BLANK_ID 1
+
+/* A cursor shape shared by its users; the image is never modified */
+typedef struct {
+    MonoGlueCursor cursor;
+    guint64        hash;
+    /* Identifies the shape in the whole process, never 0 */
+    uint32_t       id;
+    gint           ref_count;
+    /* Last lookup that returned it, to evict the least recently used */
+    guint64        last_used;
+} GlueCursor;
+
+/*
+ * Cursors of a display, keyed by a hash of their size, hot spot and
+ * pixels, so that the shapes a guest keeps switching between (arrow,
+ * I-beam, hand...) are copied only once. Not thread safe, it is used
+ * with the cursor_lock of the display held.
+ */
+typedef struct {
+    GlueCursor     *entries[GLUE_CURSOR_CACHE_SIZE];
+    guint64        lookups;
+} GlueCursorCache;
+
+void glue_cursor_cache_init(GlueCursorCache *cache);
+/* Drops the references of the cache; cursors still in use stay alive */
+void glue_cursor_cache_clear(GlueCursorCache *cache);
+
+/* Returns a new reference to the cached cursor with this image, adding
+ * it (and evicting the least recently used one) if it is not there. */
+GlueCursor *glue_cursor_cache_lookup(GlueCursorCache *cache,
+				     uint32_t width, uint32_t height,
+				     uint32_t hot_x, uint32_t hot_y,
+				     const uint32_t *rgba);
+
+GlueCursor *glue_cursor_ref(GlueCursor *cursor);
+void glue_cursor_unref(GlueCursor *cursor);
+
+/* Transparent 1x1 cursor shown while the guest hides its cursor. It is
+ * shared by all the displays and never freed, do not ref or unref it. */
+const GlueCursor *glue_cursor_blank(void);
+
+/*
+ * Cursor a display shows to the host: the last shape set by the guest and
+ * whether the guest shows it. Hiding and showing it only flips a flag, so
+ * that it never allocates. Not thread safe, it is used with the
+ * cursor_lock of the display held.
+ */
+typedef struct {
+    /* Reference owned by the view, NULL if there is none */
+    GlueCursor     *shape;
+    /* FALSE while the guest hides shape */
+    gboolean       visible;
+    /* Id of the shape shown to the host: GLUE_CURSOR_BLANK_ID while the
+     * cursor is hidden, 0 if there is none */
+    uint32_t       id;
+} GlueCursorView;
+
+void glue_cursor_view_init(GlueCursorView *view);
+/* Takes the reference of shape, which may be NULL */
+void glue_cursor_view_set_shape(GlueCursorView *view, GlueCursor *shape);
+void glue_cursor_view_set_visible(GlueCursorView *view, gboolean visible);
+/* Shape shown to the host, the blank cursor while it is hidden */
+const GlueCursor *glue_cursor_view_get_shown(const GlueCursorView *view);
+
+/*
+ * Cursor state written by the GLib main loop and polled by the host render
+ * thread. It is a seqlock: the writer makes the sequence odd while it
+ * updates the fields, and readers retry until they read the same even
+ * sequence before and after copying them, so neither side ever blocks.
+ * There must be a single writer.
+ */
+typedef struct {
+    volatile gint  sequence;
+    volatile gint  x, y;
+    volatile gint  visible;
+    volatile gint  mouse_mode;
+    volatile guint cursor_id;
+} GlueCursorState;
+
+void glue_cursor_state_init(GlueCursorState *state);
+void glue_cursor_state_publish(GlueCursorState *state, const MonoGlueCursorState *value);
+void glue_cursor_state_read(GlueCursorState *state, MonoGlueCursorState *value);
+
+#endif /* GLUE_CURSOR_H_ */
@@ -0,0 +1,136 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Single-producer, single-consumer ring of input events, from the host UI
+ * thread to the GLib main loop, which owns the spice-glib objects. Neither
+ * side takes a lock. The producer only wakes the main loop up once per
+ * burst: the flag is cleared by the source right before draining.
+ */
+
+#include "glue-input-ring.h"
+
+static struct {
+    GlueQueuedInput entries[GLUE_INPUT_RING_SIZE];
+    /* Free-running counters, only written by the producer and the consumer */
+    volatile guint  head;
+    volatile guint  tail;
+    /* TRUE from the first push after a drain until the next drain */
+    volatile gint   wakeup_pending;
+    volatile gint   wakeups;
+    GlueInputFunc   func;
+    gpointer        user_data;
+} ring;
+
+static gboolean ring_is_empty(void)
+{
+    return g_atomic_int_get((volatile gint *)&ring.head) ==
+	g_atomic_int_get((volatile gint *)&ring.tail);
+}
+
+static gboolean ring_source_prepare(GSource *source, gint *timeout)
+{
+    *timeout = -1;
+    return !ring_is_empty();
+}
+
+static gboolean ring_source_check(GSource *source)
+{
+    return !ring_is_empty();
+}
+
+/* Runs the events that are in the ring when it starts; the ones pushed
+ * meanwhile run in the next iteration. Called by the owner of the main
+ * context only */
+static void ring_drain(void)
+{
+    guint tail = ring.tail;
+    guint head;
+
+    g_atomic_int_set(&ring.wakeup_pending, FALSE);
+    head = g_atomic_int_get((volatile gint *)&ring.head);
+    while (tail != head) {
+	ring.func(&ring.entries[tail % GLUE_INPUT_RING_SIZE], ring.user_data);
+	tail++;
+	/* Frees the entry for the producer */
+	g_atomic_int_set((volatile gint *)&ring.tail, tail);
+    }
+}
+
+static gboolean ring_source_dispatch(GSource *source, GSourceFunc callback,
+				     gpointer user_data)
+{
+    ring_drain();
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs ring_source_funcs = {
+    ring_source_prepare, ring_source_check, ring_source_dispatch, NULL
+};
+
+void glue_input_ring_init(GlueInputFunc func, gpointer user_data)
+{
+    static gsize initialized = 0;
+    GSource *source;
+
+    if (!g_once_init_enter(&initialized))
+	return;
+
+    ring.func = func;
+    ring.user_data = user_data;
+    source = g_source_new(&ring_source_funcs, sizeof(GSource));
+    g_source_attach(source, NULL);
+    g_source_unref(source);
+    g_once_init_leave(&initialized, 1);
+}
+
+gboolean glue_input_ring_push(const GlueQueuedInput *input)
+{
+    guint head = ring.head;
+
+    if (head - g_atomic_int_get((volatile gint *)&ring.tail) >= GLUE_INPUT_RING_SIZE)
+	return FALSE;
+
+    ring.entries[head % GLUE_INPUT_RING_SIZE] = *input;
+    /* A full barrier, so the entry is visible before the new head */
+    g_atomic_int_set((volatile gint *)&ring.head, head + 1);
+
+    if (g_atomic_int_compare_and_exchange(&ring.wakeup_pending, FALSE, TRUE)) {
+	g_atomic_int_inc(&ring.wakeups);
+	g_main_context_wakeup(NULL);
+    }
+    return TRUE;
+}
+
+void glue_input_ring_flush(void)
+{
+    while (!ring_is_empty()) {
+	if (g_main_context_acquire(NULL)) {
+	    ring_drain();
+	    g_main_context_release(NULL);
+	} else {
+	    g_main_context_wakeup(NULL);
+	    g_usleep(1000);
+	}
+    }
+}
+
+guint glue_input_ring_get_wakeups(void)
+{
+    return g_atomic_int_get(&ring.wakeups);
+}
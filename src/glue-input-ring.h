@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GLUE_INPUT_RING_H_
+#define GLUE_INPUT_RING_H_
+
+#include <stdint.h>
+#include "glib.h"
+#include "mono-glue-types.h"
+
+/* Events that fit in the ring, a power of two */
+#define GLUE_INPUT_RING_SIZE 1024
+
+/* Type of the queued focus changes of the host window, which keep their
+ * order with the events; isDown is TRUE when the focus is gained. It is
+ * not a GlueInputEventType, the host cannot send it */
+#define GLUE_INPUT_EVENT_FOCUS -1
+
+/* An input event sent by the host, waiting for the main loop */
+typedef struct {
+    GlueInputEvent event;
+    /* Pipeline of the display, channel -1 for the default display */
+    gint           channel_id;
+    gint           monitor_id;
+    /* When it entered the glue, 0 if it is not traced */
+    gint64         received;
+} GlueQueuedInput;
+
+/* Runs a queued event, from the GLib main loop */
+typedef void (*GlueInputFunc)(const GlueQueuedInput *input, gpointer user_data);
+
+/* Attaches the source that drains the ring to the default main context.
+ * Only the first call has any effect. */
+void glue_input_ring_init(GlueInputFunc func, gpointer user_data);
+
+/* Copies the event to the ring and wakes the main loop up if it is not
+ * awake already. Returns FALSE if the ring is full. It is wait-free, but
+ * there must be a single producer thread. */
+gboolean glue_input_ring_push(const GlueQueuedInput *input);
+
+/* Waits until every event pushed so far has run, from the producer thread.
+ * If no other thread runs the main loop, it runs them itself. */
+void glue_input_ring_flush(void);
+
+/* Times the producer has woken the main loop up, for the tests */
+guint glue_input_ring_get_wakeups(void);
+
+#endif /* GLUE_INPUT_RING_H_ */
@@ -0,0 +1,131 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Frame-ready notifications, so that the host can wait for new frames in
+ * its own event loop instead of polling SpiceGlibGlueLockDisplayBuffer().
+ *
+ * The fd is written at most once until the host clears it, so that a host
+ * that does not read it never fills the pipe.
+ */
+
+#include <spice-gtk/spice-util.h>
+
+#include "glue-notify.h"
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+/* read_fd == write_fd with an eventfd */
+static int read_fd = -1;
+static int write_fd = -1;
+/* TRUE while the fd is readable */
+static volatile gint signalled = FALSE;
+
+static GMutex callback_lock;
+static GlueFrameReadyCallback frame_ready_callback = NULL;
+static void *frame_ready_data = NULL;
+
+void glue_notify_init(void)
+{
+    if (read_fd != -1)
+	return;
+
+#if defined(__linux__)
+    read_fd = write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (read_fd == -1)
+	g_warning("Could not create the frame-ready eventfd: %s", g_strerror(errno));
+#elif !defined(WIN32)
+    {
+	int fds[2], i;
+
+	if (pipe(fds) == -1) {
+	    g_warning("Could not create the frame-ready pipe: %s", g_strerror(errno));
+	    return;
+	}
+	for (i = 0; i < 2; i++) {
+	    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+	    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+	read_fd = fds[0];
+	write_fd = fds[1];
+    }
+#endif
+}
+
+int glue_notify_get_fd(void)
+{
+    return read_fd;
+}
+
+void glue_notify_set_callback(GlueFrameReadyCallback callback, void *user_data)
+{
+    g_mutex_lock(&callback_lock);
+    frame_ready_callback = callback;
+    frame_ready_data = user_data;
+    g_mutex_unlock(&callback_lock);
+}
+
+void glue_notify_signal(void)
+{
+#ifndef WIN32
+    if (write_fd != -1 &&
+	g_atomic_int_compare_and_exchange(&signalled, FALSE, TRUE)) {
+	uint64_t one = 1;
+	/* 8 bytes for the eventfd counter, a pipe just needs something */
+	if (write(write_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+	    SPICE_DEBUG("Could not signal the frame-ready fd: %s", g_strerror(errno));
+    }
+#endif
+}
+
+void glue_notify_frame_ready(int32_t channel_id, int32_t monitor_id,
+			     uint32_t sequence)
+{
+    GlueFrameReadyCallback callback;
+    void *user_data;
+
+    glue_notify_signal();
+
+    g_mutex_lock(&callback_lock);
+    callback = frame_ready_callback;
+    user_data = frame_ready_data;
+    g_mutex_unlock(&callback_lock);
+    if (callback != NULL)
+	callback(channel_id, monitor_id, sequence, user_data);
+}
+
+void glue_notify_clear(void)
+{
+#ifndef WIN32
+    uint64_t buffer[8];
+
+    if (read_fd == -1 || !g_atomic_int_get(&signalled))
+	return;
+
+    /* Empty the fd before allowing another write */
+    while (read(read_fd, buffer, sizeof(buffer)) > 0)
+	;
+    g_atomic_int_set(&signalled, FALSE);
+#endif
+}
@@ -0,0 +1,50 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_NOTIFY_H_
+#define GLUE_NOTIFY_H_
+
+#include <stdint.h>
+#include "glib.h"
+
+/* Called from the GLib main loop each time a new frame is published, with
+ * the display channel and monitor of the frame */
+typedef void (*GlueFrameReadyCallback)(int32_t channel_id, int32_t monitor_id,
+				       uint32_t sequence, void *user_data);
+
+/* Creates the notification fd: an eventfd on Linux, a pipe on other
+ * Unix systems. There is no fd on Windows, only the callback. */
+void glue_notify_init(void);
+
+/* Readable end of the notification fd, -1 if there is none */
+int glue_notify_get_fd(void);
+
+void glue_notify_set_callback(GlueFrameReadyCallback callback, void *user_data);
+
+/* Signals the fd and calls the callback. It must be called after the frame
+ * is visible to the host, and without holding any display lock. */
+void glue_notify_frame_ready(int32_t channel_id, int32_t monitor_id,
+			     uint32_t sequence);
+
+/* Makes the fd readable, without calling the callback */
+void glue_notify_signal(void);
+
+/* Makes the fd not readable. The host calls it before looking for a new
+ * frame, so that a frame published right after is not missed. */
+void glue_notify_clear(void);
+
+#endif /* GLUE_NOTIFY_H_ */
@@ -0,0 +1,94 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * One display pipeline per (channel_id, monitor_id), so that every guest
+ * monitor has its own buffers, damage and copy scheduling.
+ */
+
+#include "glue-pipeline.h"
+
+GluePipeline *glue_pipelines_new(void)
+{
+    GluePipeline *pipelines = g_new0(GluePipeline, GLUE_MAX_PIPELINES);
+    int i;
+
+    for (i = 0; i < GLUE_MAX_PIPELINES; i++) {
+	GluePipeline *p = &pipelines[i];
+
+	p->channel_id = i / GLUE_MAX_MONITORS;
+	p->monitor_id = i % GLUE_MAX_MONITORS;
+	g_mutex_init(&p->lock);
+	pixman_region32_init(&p->invalidate_region);
+	pixman_region32_init(&p->published_region);
+	pixman_region32_init(&p->locked_region);
+	glue_scaler_init(&p->scaler);
+	glue_tiles_init(&p->tile_hashes);
+	glue_triple_buffer_init(&p->triple_buffer);
+	glue_shm_init(&p->shm);
+    }
+    return pipelines;
+}
+
+void glue_pipelines_free(GluePipeline *pipelines)
+{
+    int i;
+
+    if (pipelines == NULL)
+	return;
+
+    for (i = 0; i < GLUE_MAX_PIPELINES; i++) {
+	GluePipeline *p = &pipelines[i];
+
+	pixman_region32_fini(&p->invalidate_region);
+	pixman_region32_fini(&p->published_region);
+	pixman_region32_fini(&p->locked_region);
+	glue_scaler_clear(&p->scaler);
+	glue_tiles_clear(&p->tile_hashes);
+	glue_triple_buffer_clear(&p->triple_buffer);
+	glue_shm_clear(&p->shm);
+	g_free(p->last_surface);
+	g_mutex_clear(&p->lock);
+    }
+    g_free(pipelines);
+}
+
+GluePipeline *glue_pipelines_find(GluePipeline *pipelines,
+				  int32_t channel_id, int32_t monitor_id)
+{
+    if (channel_id < 0 || channel_id >= GLUE_MAX_CHANNELS ||
+	monitor_id < 0 || monitor_id >= GLUE_MAX_MONITORS)
+	return NULL;
+
+    return &pipelines[channel_id * GLUE_MAX_MONITORS + monitor_id];
+}
+
+void glue_pipeline_attach(GluePipeline *pipeline, SpiceDisplay *display)
+{
+    g_mutex_lock(&pipeline->lock);
+    pipeline->display = display;
+    g_mutex_unlock(&pipeline->lock);
+}
+
+/* The last frame stays published, the host keeps showing it */
+void glue_pipeline_detach(GluePipeline *pipeline, SpiceDisplay *display)
+{
+    g_mutex_lock(&pipeline->lock);
+    if (pipeline->display == display)
+	pipeline->display = NULL;
+    g_mutex_unlock(&pipeline->lock);
+}
@@ -0,0 +1,110 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_PIPELINE_H_
+#define GLUE_PIPELINE_H_
+
+#include <stdint.h>
+#include <pixman.h>
+#include "glib.h"
+#include "glue-spice-widget.h"
+#include "glue-scale.h"
+#include "glue-tiles.h"
+#include "glue-triple-buffer.h"
+#include "glue-shm.h"
+#include "glue-stats.h"
+
+/* Same limits as the windows of a spice_connection */
+#define GLUE_MAX_CHANNELS 4
+#define GLUE_MAX_MONITORS 4
+#define GLUE_MAX_PIPELINES (GLUE_MAX_CHANNELS * GLUE_MAX_MONITORS)
+
+/*
+ * Display state of one guest monitor, from the damage received by
+ * invalidate() to the frame handed to the host. Each session creates its
+ * pipelines once and frees them with the session, so that the host can
+ * lock them while displays come and go.
+ */
+typedef struct {
+    gint              channel_id;
+    gint              monitor_id;
+    /* Protects the frames and the published damage against the host */
+    GMutex            lock;
+    /* Display currently attached, NULL if there is none */
+    SpiceDisplay      *display;
+
+    /* Host buffer of GLUE_DISPLAY_EXPORT_COPY mode, and its size */
+    uint32_t          *buffer;
+    int32_t           buffer_width, buffer_height;
+    /* A frame has been published and not taken by the host yet, in
+     * GLUE_DISPLAY_EXPORT_COPY and GLUE_DISPLAY_EXPORT_SURFACE modes.
+     * Written with the lock held, but read atomically without it */
+    volatile gint     updated;
+    /* Size of the surface the last time invalidate() was called */
+    int32_t           local_width, local_height;
+    /* Size of the published frame, smaller than the surface when it is
+     * downscaled. Only written with the lock held, when a frame is published */
+    int32_t           frame_width, frame_height;
+    /* Incremented each time a new frame is published to the host */
+    uint32_t          frame_sequence;
+
+    /* Area of the surface pending to be copied by copy_display_to_glue() */
+    gboolean          invalidated;
+    pixman_region32_t invalidate_region;
+    /* When the first damage of the frame being built arrived, 0 if none yet */
+    gint64            first_invalidate;
+    /* Damage published since the last lock, and before the current one */
+    pixman_region32_t published_region;
+    pixman_region32_t locked_region;
+
+    /* One-shot source that runs the copy, NULL when no damage is pending
+     * or the copy waits for the surface or the host buffers */
+    GSource           *copy_source;
+    gint64            last_copy_timestamp;
+
+    /* Downscaling in GLUE_DISPLAY_EXPORT_COPY mode, and size of the last copy */
+    GlueScaler        scaler;
+    int32_t           copied_width, copied_height;
+    GlueTileHashes    tile_hashes;
+    GlueTripleBuffer  triple_buffer;
+    GlueShm           shm;
+
+    /* Input event followed until its response is published */
+    GlueInputTrace    input_trace;
+
+    /* Pixels of the last primary surface, kept when its channel goes away
+     * and restored into the next one of the same format and size, so that
+     * a reconnection does not start from a black surface */
+    guint8            *last_surface;
+    gint              last_format, last_width, last_height, last_stride;
+    /* GlueSession.server_generation of the display it comes from */
+    guint             last_generation;
+} GluePipeline;
+
+/* GLUE_MAX_PIPELINES pipelines, one per display channel and monitor */
+GluePipeline *glue_pipelines_new(void);
+/* No display may be attached to them anymore */
+void glue_pipelines_free(GluePipeline *pipelines);
+
+/* Returns NULL if the ids are out of range */
+GluePipeline *glue_pipelines_find(GluePipeline *pipelines,
+				  int32_t channel_id, int32_t monitor_id);
+
+void glue_pipeline_attach(GluePipeline *pipeline, SpiceDisplay *display);
+void glue_pipeline_detach(GluePipeline *pipeline, SpiceDisplay *display);
+
+#endif /* GLUE_PIPELINE_H_ */
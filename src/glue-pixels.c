@@ -0,0 +1,364 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pixel conversion kernels used to copy the spice primary surface to the
+ * glue display buffer.
+ *
+ * Every kernel converts a single row. SIMD versions are built with the
+ * target attribute, so the library still runs on CPUs without them;
+ * glue_pixels_init() picks the best one with cpuid (x86) or HWCAP (ARM).
+ */
+
+#include <string.h>
+#include "glib.h"
+#include <spice-gtk/spice-util.h>
+
+#include "glue-pixels.h"
+
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+#define GLUE_PIXELS_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || (defined(__arm__) && defined(__ARM_NEON__))
+#define GLUE_PIXELS_NEON
+#include <arm_neon.h>
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+static inline uint32_t argb_to_abgr(uint32_t x)
+{
+    return 0xFF000000 |              // ______AA
+	((x & 0x00FF0000) >> 16) |   // ____RR__
+        (x & 0x0000FF00) |           // __GG____
+        ((x & 0x000000FF) <<  16 );  // BB______
+}
+
+static void argb_to_abgr_row_scalar(uint32_t *dst, const void *src, int n)
+{
+    const uint32_t *s = src;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	dst[i] = argb_to_abgr(s[i]);
+    }
+}
+
+#define CONVERT_0565_TO_0888(s)					\
+    (((((s) << 3) & 0xf8) | (((s) >> 2) & 0x7)) |		\
+     ((((s) << 5) & 0xfc00) | (((s) >> 1) & 0x300)) |		\
+     ((((s) << 8) & 0xf80000) | (((s) << 3) & 0x70000)))
+
+#define CONVERT_0565_TO_8888(s) (CONVERT_0565_TO_0888(s) | 0xff000000)
+
+#define CONVERT_0555_TO_0888(s)				\
+    (((((s) & 0x001f) << 3) | (((s) & 0x001c) >> 2)) |	\
+     ((((s) & 0x03e0) << 6) | (((s) & 0x0380) << 1)) |	\
+     ((((s) & 0x7c00) << 9) | ((((s) & 0x7000)) << 4)))
+
+#define CONVERT_0555_TO_8888(s) (CONVERT_0555_TO_0888(s) | 0xff000000)
+
+static void rgb565_to_abgr_row_scalar(uint32_t *dst, const void *src, int n)
+{
+    const uint16_t *s = src;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	dst[i] = argb_to_abgr(CONVERT_0565_TO_8888((uint32_t)s[i]));
+    }
+}
+
+static void rgb555_to_abgr_row_scalar(uint32_t *dst, const void *src, int n)
+{
+    const uint16_t *s = src;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	dst[i] = argb_to_abgr(CONVERT_0555_TO_8888((uint32_t)s[i]));
+    }
+}
+
+#ifdef GLUE_PIXELS_X86
+__attribute__((target("sse2")))
+static void argb_to_abgr_row_sse2(uint32_t *dst, const void *src, int n)
+{
+    const uint32_t *s = src;
+    const __m128i mask_rb = _mm_set1_epi32(0x00FF00FF);
+    const __m128i mask_ga = _mm_set1_epi32(0xFF00FF00);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+	__m128i p = _mm_loadu_si128((const __m128i *)(s + i));
+	__m128i rb = _mm_and_si128(p, mask_rb);
+	__m128i ga = _mm_and_si128(p, mask_ga);
+	/* 0x00RR00BB -> 0x00BB00RR swapping the 16 bits words */
+	rb = _mm_shufflelo_epi16(rb, _MM_SHUFFLE(2, 3, 0, 1));
+	rb = _mm_shufflehi_epi16(rb, _MM_SHUFFLE(2, 3, 0, 1));
+	p = _mm_or_si128(_mm_or_si128(rb, ga), alpha);
+	_mm_storeu_si128((__m128i *)(dst + i), p);
+    }
+    argb_to_abgr_row_scalar(dst + i, s + i, n - i);
+}
+
+__attribute__((target("ssse3")))
+static void argb_to_abgr_row_ssse3(uint32_t *dst, const void *src, int n)
+{
+    const uint32_t *s = src;
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7,
+					  10, 9, 8, 11, 14, 13, 12, 15);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+	__m128i p0 = _mm_loadu_si128((const __m128i *)(s + i));
+	__m128i p1 = _mm_loadu_si128((const __m128i *)(s + i + 4));
+	p0 = _mm_or_si128(_mm_shuffle_epi8(p0, shuffle), alpha);
+	p1 = _mm_or_si128(_mm_shuffle_epi8(p1, shuffle), alpha);
+	_mm_storeu_si128((__m128i *)(dst + i), p0);
+	_mm_storeu_si128((__m128i *)(dst + i + 4), p1);
+    }
+    argb_to_abgr_row_scalar(dst + i, s + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void argb_to_abgr_row_avx2(uint32_t *dst, const void *src, int n)
+{
+    const uint32_t *s = src;
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7,
+					     10, 9, 8, 11, 14, 13, 12, 15,
+					     2, 1, 0, 3, 6, 5, 4, 7,
+					     10, 9, 8, 11, 14, 13, 12, 15);
+    const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+	__m256i p0 = _mm256_loadu_si256((const __m256i *)(s + i));
+	__m256i p1 = _mm256_loadu_si256((const __m256i *)(s + i + 8));
+	p0 = _mm256_or_si256(_mm256_shuffle_epi8(p0, shuffle), alpha);
+	p1 = _mm256_or_si256(_mm256_shuffle_epi8(p1, shuffle), alpha);
+	_mm256_storeu_si256((__m256i *)(dst + i), p0);
+	_mm256_storeu_si256((__m256i *)(dst + i + 8), p1);
+    }
+    argb_to_abgr_row_ssse3(dst + i, s + i, n - i);
+}
+
+/* Expands 8 16 bits pixels, given their 5 or 6 bits components in 16 bits
+ * lanes, to 8 bits per component and stores them as ABGR */
+__attribute__((target("sse2")))
+static inline void store_rgb16_sse2(uint32_t *dst, __m128i r, __m128i g, __m128i b,
+				    int g_bits)
+{
+    const __m128i alpha = _mm_set1_epi16(0xFF00);
+    __m128i rg, ba;
+
+    r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+    b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+    if (g_bits == 6)
+	g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+    else
+	g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+
+    rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    ba = _mm_or_si128(b, alpha);
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i *)(dst + 4), _mm_unpackhi_epi16(rg, ba));
+}
+
+__attribute__((target("sse2")))
+static void rgb565_to_abgr_row_sse2(uint32_t *dst, const void *src, int n)
+{
+    const uint16_t *s = src;
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+	__m128i p = _mm_loadu_si128((const __m128i *)(s + i));
+	__m128i r = _mm_srli_epi16(p, 11);
+	__m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+	__m128i b = _mm_and_si128(p, mask5);
+	store_rgb16_sse2(dst + i, r, g, b, 6);
+    }
+    rgb565_to_abgr_row_scalar(dst + i, s + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void rgb555_to_abgr_row_sse2(uint32_t *dst, const void *src, int n)
+{
+    const uint16_t *s = src;
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+	__m128i p = _mm_loadu_si128((const __m128i *)(s + i));
+	__m128i r = _mm_and_si128(_mm_srli_epi16(p, 10), mask5);
+	__m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask5);
+	__m128i b = _mm_and_si128(p, mask5);
+	store_rgb16_sse2(dst + i, r, g, b, 5);
+    }
+    rgb555_to_abgr_row_scalar(dst + i, s + i, n - i);
+}
+#endif /* GLUE_PIXELS_X86 */
+
+#ifdef GLUE_PIXELS_NEON
+static void argb_to_abgr_row_neon(uint32_t *dst, const void *src, int n)
+{
+    const uint32_t *s = src;
+    const uint8x16_t alpha = vdupq_n_u8(0xFF);
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+	/* Deinterleaves into B, G, R, A planes */
+	uint8x16x4_t p = vld4q_u8((const uint8_t *)(s + i));
+	uint8x16_t b = p.val[0];
+	p.val[0] = p.val[2];
+	p.val[2] = b;
+	p.val[3] = alpha;
+	vst4q_u8((uint8_t *)(dst + i), p);
+    }
+    argb_to_abgr_row_scalar(dst + i, s + i, n - i);
+}
+
+/* Expands 8 16 bits pixels, given their 5 or 6 bits components in 16 bits
+ * lanes, to 8 bits per component and stores them as ABGR */
+static inline void store_rgb16_neon(uint32_t *dst, uint16x8_t r, uint16x8_t g,
+				    uint16x8_t b, int g_bits)
+{
+    uint8x8x4_t p;
+
+    r = vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2));
+    b = vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2));
+    if (g_bits == 6)
+	g = vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4));
+    else
+	g = vorrq_u16(vshlq_n_u16(g, 3), vshrq_n_u16(g, 2));
+
+    p.val[0] = vmovn_u16(r);
+    p.val[1] = vmovn_u16(g);
+    p.val[2] = vmovn_u16(b);
+    p.val[3] = vdup_n_u8(0xFF);
+    vst4_u8((uint8_t *)dst, p);
+}
+
+static void rgb565_to_abgr_row_neon(uint32_t *dst, const void *src, int n)
+{
+    const uint16_t *s = src;
+    const uint16x8_t mask5 = vdupq_n_u16(0x1f);
+    const uint16x8_t mask6 = vdupq_n_u16(0x3f);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+	uint16x8_t p = vld1q_u16(s + i);
+	store_rgb16_neon(dst + i, vshrq_n_u16(p, 11),
+			 vandq_u16(vshrq_n_u16(p, 5), mask6),
+			 vandq_u16(p, mask5), 6);
+    }
+    rgb565_to_abgr_row_scalar(dst + i, s + i, n - i);
+}
+
+static void rgb555_to_abgr_row_neon(uint32_t *dst, const void *src, int n)
+{
+    const uint16_t *s = src;
+    const uint16x8_t mask5 = vdupq_n_u16(0x1f);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+	uint16x8_t p = vld1q_u16(s + i);
+	store_rgb16_neon(dst + i, vandq_u16(vshrq_n_u16(p, 10), mask5),
+			 vandq_u16(vshrq_n_u16(p, 5), mask5),
+			 vandq_u16(p, mask5), 5);
+    }
+    rgb555_to_abgr_row_scalar(dst + i, s + i, n - i);
+}
+#endif /* GLUE_PIXELS_NEON */
+
+GlueConvertRowFunc glue_argb_to_abgr_row = argb_to_abgr_row_scalar;
+GlueConvertRowFunc glue_rgb565_to_abgr_row = rgb565_to_abgr_row_scalar;
+GlueConvertRowFunc glue_rgb555_to_abgr_row = rgb555_to_abgr_row_scalar;
+static const char *kernel_name = "scalar";
+
+/* Every kernel set the library is built with, slowest first.
+ * The 16 bits kernels of the SSE2 set are shared by the faster x86 sets. */
+static const GluePixelKernels all_kernels[] = {
+    { "scalar", argb_to_abgr_row_scalar,
+      rgb565_to_abgr_row_scalar, rgb555_to_abgr_row_scalar },
+#ifdef GLUE_PIXELS_X86
+    { "sse2", argb_to_abgr_row_sse2,
+      rgb565_to_abgr_row_sse2, rgb555_to_abgr_row_sse2 },
+    { "ssse3", argb_to_abgr_row_ssse3,
+      rgb565_to_abgr_row_sse2, rgb555_to_abgr_row_sse2 },
+    { "avx2", argb_to_abgr_row_avx2,
+      rgb565_to_abgr_row_sse2, rgb555_to_abgr_row_sse2 },
+#endif
+#ifdef GLUE_PIXELS_NEON
+    { "neon", argb_to_abgr_row_neon,
+      rgb565_to_abgr_row_neon, rgb555_to_abgr_row_neon },
+#endif
+};
+
+static gboolean kernels_supported(const GluePixelKernels *kernels)
+{
+#ifdef GLUE_PIXELS_X86
+    __builtin_cpu_init();
+    if (strcmp(kernels->name, "sse2") == 0)
+	return __builtin_cpu_supports("sse2");
+    if (strcmp(kernels->name, "ssse3") == 0)
+	return __builtin_cpu_supports("ssse3");
+    if (strcmp(kernels->name, "avx2") == 0)
+	return __builtin_cpu_supports("avx2");
+#endif
+#if defined(GLUE_PIXELS_NEON) && defined(__arm__) && defined(__linux__)
+    if (strcmp(kernels->name, "neon") == 0)
+	return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+    return TRUE;
+}
+
+int glue_pixels_get_kernels(const GluePixelKernels **kernels, int max_kernels)
+{
+    int i, n = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(all_kernels) && n < max_kernels; i++) {
+	if (kernels_supported(&all_kernels[i]))
+	    kernels[n++] = &all_kernels[i];
+    }
+    return n;
+}
+
+void glue_pixels_init(void)
+{
+    const GluePixelKernels *kernels[G_N_ELEMENTS(all_kernels)];
+    int n = glue_pixels_get_kernels(kernels, G_N_ELEMENTS(kernels));
+
+    /* The scalar set is always supported */
+    glue_argb_to_abgr_row = kernels[n - 1]->argb_to_abgr_row;
+    glue_rgb565_to_abgr_row = kernels[n - 1]->rgb565_to_abgr_row;
+    glue_rgb555_to_abgr_row = kernels[n - 1]->rgb555_to_abgr_row;
+    kernel_name = kernels[n - 1]->name;
+
+    SPICE_DEBUG("Using %s pixel conversion kernels", kernel_name);
+}
+
+const char *glue_pixels_kernel_name(void)
+{
+    return kernel_name;
+}
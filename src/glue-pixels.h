@@ -0,0 +1,52 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_PIXELS_H_
+#define GLUE_PIXELS_H_
+
+#include <stdint.h>
+
+/* Converts a row of n pixels from src to dst */
+typedef void (*GlueConvertRowFunc)(uint32_t *dst, const void *src, int n);
+
+/* xRGB (spice 32 bits surface) -> ABGR (glue display buffer), alpha set to 0xFF */
+extern GlueConvertRowFunc glue_argb_to_abgr_row;
+/* RGB 565 and 555 (spice 16 bits surfaces) -> ABGR, alpha set to 0xFF */
+extern GlueConvertRowFunc glue_rgb565_to_abgr_row;
+extern GlueConvertRowFunc glue_rgb555_to_abgr_row;
+
+/* A set of row conversion kernels built for one instruction set */
+typedef struct {
+    const char         *name;
+    GlueConvertRowFunc argb_to_abgr_row;
+    GlueConvertRowFunc rgb565_to_abgr_row;
+    GlueConvertRowFunc rgb555_to_abgr_row;
+} GluePixelKernels;
+
+/* Gets the kernel sets that the running CPU supports, slowest first, so
+ * that they can be compared (see tests/bench-pixels.c).
+ * Returns how many of them have been written to kernels, at most max_kernels */
+int glue_pixels_get_kernels(const GluePixelKernels **kernels, int max_kernels);
+
+/* Selects the fastest row conversion kernels for the running CPU.
+ * Until it is called, the scalar kernels are used. */
+void glue_pixels_init(void);
+
+/* Name of the selected xRGB -> ABGR kernel, for logging purposes */
+const char *glue_pixels_kernel_name(void);
+
+#endif /* GLUE_PIXELS_H_ */
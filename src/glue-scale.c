@@ -0,0 +1,237 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Downscaling of the primary surface into the glue display buffer.
+ *
+ * Source rows are converted to ABGR with the row kernels of glue-pixels.c
+ * into a small per-call buffer, and filtered from there straight into the
+ * destination, so a full size copy of the surface is never written.
+ */
+
+#include <string.h>
+
+#include "glue-scale.h"
+
+void glue_scaler_init(GlueScaler *scaler)
+{
+    memset(scaler, 0, sizeof(*scaler));
+}
+
+void glue_scaler_clear(GlueScaler *scaler)
+{
+    g_free(scaler->x_src);
+    g_free(scaler->y_src);
+    g_free(scaler->x_frac);
+    g_free(scaler->y_frac);
+    glue_scaler_init(scaler);
+}
+
+/* Sample position of each destination pixel, in 1/256 of source pixel */
+static void setup_bilinear_axis(int src, int dst, int *first, guint8 *frac)
+{
+    int i;
+
+    for (i = 0; i < dst; i++) {
+	gint64 pos = (gint64)(2 * i + 1) * src * 128 / dst - 128;
+	if (pos < 0)
+	    pos = 0;
+	first[i] = pos >> 8;
+	frac[i] = pos & 0xFF;
+	if (first[i] >= src - 1) {
+	    first[i] = src - 1;
+	    frac[i] = 0;
+	}
+    }
+}
+
+/* Source pixels [first[i], first[i + 1]) are averaged into destination pixel i */
+static void setup_box_axis(int src, int dst, int *first)
+{
+    int i;
+
+    for (i = 0; i <= dst; i++) {
+	first[i] = (gint64)i * src / dst;
+    }
+}
+
+void glue_scaler_setup(GlueScaler *scaler, int src_width, int src_height,
+		       int dst_width, int dst_height)
+{
+    if (scaler->src_width == src_width && scaler->src_height == src_height &&
+	scaler->dst_width == dst_width && scaler->dst_height == dst_height)
+	return;
+
+    glue_scaler_clear(scaler);
+    scaler->src_width = src_width;
+    scaler->src_height = src_height;
+    scaler->dst_width = dst_width;
+    scaler->dst_height = dst_height;
+    scaler->box = dst_width * 2 <= src_width || dst_height * 2 <= src_height;
+
+    scaler->x_src = g_new(int, dst_width + 1);
+    scaler->y_src = g_new(int, dst_height + 1);
+    if (scaler->box) {
+	setup_box_axis(src_width, dst_width, scaler->x_src);
+	setup_box_axis(src_height, dst_height, scaler->y_src);
+    } else {
+	scaler->x_frac = g_new(guint8, dst_width);
+	scaler->y_frac = g_new(guint8, dst_height);
+	setup_bilinear_axis(src_width, dst_width, scaler->x_src, scaler->x_frac);
+	setup_bilinear_axis(src_height, dst_height, scaler->y_src, scaler->y_frac);
+    }
+}
+
+/* The sample of a destination pixel may reach one source pixel beyond
+ * its nominal area, so the mapping is widened by one pixel on each side. */
+void glue_scaler_map_region(const GlueScaler *scaler, pixman_region32_t *dst,
+			    pixman_region32_t *src)
+{
+    pixman_box32_t *boxes;
+    int i, n_boxes;
+
+    pixman_region32_clear(dst);
+    boxes = pixman_region32_rectangles(src, &n_boxes);
+    for (i = 0; i < n_boxes; i++) {
+	gint64 x1 = (gint64)(boxes[i].x1 - 1) * scaler->dst_width / scaler->src_width;
+	gint64 y1 = (gint64)(boxes[i].y1 - 1) * scaler->dst_height / scaler->src_height;
+	gint64 x2 = ((gint64)(boxes[i].x2 + 1) * scaler->dst_width +
+		     scaler->src_width - 1) / scaler->src_width;
+	gint64 y2 = ((gint64)(boxes[i].y2 + 1) * scaler->dst_height +
+		     scaler->src_height - 1) / scaler->src_height;
+	x1 = MAX(x1, 0);
+	y1 = MAX(y1, 0);
+	x2 = MIN(x2, scaler->dst_width);
+	y2 = MIN(y2, scaler->dst_height);
+	pixman_region32_union_rect(dst, dst, x1, y1, x2 - x1, y2 - y1);
+    }
+}
+
+/* Interpolates two ABGR pixels, two channels at a time */
+static inline uint32_t lerp(uint32_t a, uint32_t b, unsigned int f)
+{
+    uint32_t rb = (a & 0x00FF00FF) * (256 - f) + (b & 0x00FF00FF) * f;
+    uint32_t ag = ((a >> 8) & 0x00FF00FF) * (256 - f) + ((b >> 8) & 0x00FF00FF) * f;
+
+    return ((rb >> 8) & 0x00FF00FF) | (ag & 0xFF00FF00);
+}
+
+static void scale_box_bilinear(const GlueScaler *scaler, GlueConvertRowFunc convert,
+			       const guint8 *src, int src_stride, int bytes_per_pixel,
+			       uint32_t *dst, int dst_step, const pixman_box32_t *box)
+{
+    int sx1 = scaler->x_src[box->x1];
+    int sx2 = MIN(scaler->x_src[box->x2 - 1] + 2, scaler->src_width);
+    int span = sx2 - sx1;
+    uint32_t *buffer = g_new(uint32_t, span * 2);
+    /* Two converted source rows, and the row number they hold */
+    uint32_t *ra = buffer, *rb = buffer + span, *r1, *tmp;
+    int ya = -1, yb = -1;
+    int x, y;
+
+    src += sx1 * bytes_per_pixel;
+    for (y = box->y1; y < box->y2; y++) {
+	int sy = scaler->y_src[y];
+	unsigned int fy = scaler->y_frac[y];
+	int sy1 = sy + (fy != 0);
+	uint32_t *out = dst + (gint64)y * dst_step;
+
+	if (ya != sy) {
+	    if (yb == sy) {
+		tmp = ra; ra = rb; rb = tmp;
+		yb = ya;
+	    } else {
+		convert(ra, src + (gint64)sy * src_stride, span);
+	    }
+	    ya = sy;
+	}
+	if (sy1 != ya && sy1 != yb) {
+	    convert(rb, src + (gint64)sy1 * src_stride, span);
+	    yb = sy1;
+	}
+	r1 = sy1 == ya ? ra : rb;
+
+	for (x = box->x1; x < box->x2; x++) {
+	    int sx = scaler->x_src[x] - sx1;
+	    unsigned int fx = scaler->x_frac[x];
+	    int sxn = sx + (fx != 0);
+	    uint32_t top = lerp(ra[sx], ra[sxn], fx);
+
+	    out[x] = fy ? lerp(top, lerp(r1[sx], r1[sxn], fx), fy) : top;
+	}
+    }
+    g_free(buffer);
+}
+
+static void scale_box_average(const GlueScaler *scaler, GlueConvertRowFunc convert,
+			      const guint8 *src, int src_stride, int bytes_per_pixel,
+			      uint32_t *dst, int dst_step, const pixman_box32_t *box)
+{
+    int sx1 = scaler->x_src[box->x1];
+    int span = scaler->x_src[box->x2] - sx1;
+    int width = box->x2 - box->x1;
+    uint32_t *row = g_new(uint32_t, span);
+    guint32 *sums = g_new(guint32, width * 4);
+    int x, y, sx, sy;
+
+    src += sx1 * bytes_per_pixel;
+    for (y = box->y1; y < box->y2; y++) {
+	int rows = scaler->y_src[y + 1] - scaler->y_src[y];
+	uint32_t *out = dst + (gint64)y * dst_step;
+
+	memset(sums, 0, width * 4 * sizeof(guint32));
+	for (sy = scaler->y_src[y]; sy < scaler->y_src[y + 1]; sy++) {
+	    convert(row, src + (gint64)sy * src_stride, span);
+	    for (x = 0; x < width; x++) {
+		guint32 *sum = sums + x * 4;
+		for (sx = scaler->x_src[box->x1 + x] - sx1;
+		     sx < scaler->x_src[box->x1 + x + 1] - sx1; sx++) {
+		    sum[0] += row[sx] & 0xFF;
+		    sum[1] += (row[sx] >> 8) & 0xFF;
+		    sum[2] += (row[sx] >> 16) & 0xFF;
+		}
+	    }
+	}
+
+	for (x = 0; x < width; x++) {
+	    guint32 *sum = sums + x * 4;
+	    guint32 n = rows * (scaler->x_src[box->x1 + x + 1] -
+				scaler->x_src[box->x1 + x]);
+	    out[box->x1 + x] = 0xFF000000 |
+		((sum[2] + n / 2) / n) << 16 |
+		((sum[1] + n / 2) / n) << 8 |
+		((sum[0] + n / 2) / n);
+	}
+    }
+    g_free(sums);
+    g_free(row);
+}
+
+void glue_scaler_scale_box(const GlueScaler *scaler, GlueConvertRowFunc convert,
+			   const guint8 *src, int src_stride, int bytes_per_pixel,
+			   uint32_t *dst, int dst_step, const pixman_box32_t *box)
+{
+    if (box->x1 >= box->x2 || box->y1 >= box->y2)
+	return;
+
+    if (scaler->box)
+	scale_box_average(scaler, convert, src, src_stride, bytes_per_pixel,
+			  dst, dst_step, box);
+    else
+	scale_box_bilinear(scaler, convert, src, src_stride, bytes_per_pixel,
+			   dst, dst_step, box);
+}
@@ -0,0 +1,59 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_SCALE_H_
+#define GLUE_SCALE_H_
+
+#include <stdint.h>
+#include <pixman.h>
+#include "glib.h"
+#include "glue-pixels.h"
+
+/*
+ * Downscales an image while converting it to ABGR. Ratios down to 1/2 are
+ * filtered bilinearly; smaller ones average a box of source pixels per
+ * destination pixel, so that no source pixel is skipped.
+ */
+typedef struct {
+    int      src_width, src_height;
+    int      dst_width, dst_height;
+    gboolean box;
+    /* Bilinear: first source pixel and weight (0-255) of the next one.
+     * Box: first source pixel, with one extra entry for the end. */
+    int      *x_src, *y_src;
+    guint8   *x_frac, *y_frac;
+} GlueScaler;
+
+void glue_scaler_init(GlueScaler *scaler);
+void glue_scaler_clear(GlueScaler *scaler);
+
+/* Rebuilds the tables if the sizes have changed. dst must not be bigger than src. */
+void glue_scaler_setup(GlueScaler *scaler, int src_width, int src_height,
+		       int dst_width, int dst_height);
+
+/* Destination area affected by a change of the source image */
+void glue_scaler_map_region(const GlueScaler *scaler, pixman_region32_t *dst,
+			    pixman_region32_t *src);
+
+/* Writes the box of the destination image. Source rows have src_stride
+ * bytes and are converted with convert, which expands bytes_per_pixel bytes
+ * to an ABGR pixel. Destination row y starts at dst + y * dst_step pixels. */
+void glue_scaler_scale_box(const GlueScaler *scaler, GlueConvertRowFunc convert,
+			   const guint8 *src, int src_stride, int bytes_per_pixel,
+			   uint32_t *dst, int dst_step, const pixman_box32_t *box);
+
+#endif /* GLUE_SCALE_H_ */
@@ -28,6 +28,15 @@
 #include "glue-spice-widget.h"
 #include "glue-spice-widget-priv.h"
 #include "glue-spicy.h"
+#include "glue-pixels.h"
+#include "glue-stripes.h"
+#include "glue-triple-buffer.h"
+#include "glue-stats.h"
+#include "glue-notify.h"
+#include "glue-shm.h"
+#include "glue-pipeline.h"
+#include "glue-session.h"
+#include "mono-glue-types.h"
 
 #include "glib.h"
 #if defined(PRINTING) || defined(SSO)
@@ -138,50 +147,111 @@ void SpiceGlibGlue_InitializeLogging(int32_t verbosityLevel)
     SPICE_DEBUG("Logging initialized.");
 }
 
-spice_connection *mainconn;
+/* Runs the default main context, where all the sessions are dispatched */
+static GMainLoop *mainloop;
 
-void SpiceGlibGlue_MainLoop(void)
+/*
+ * Call from the host into the main loop. spice-glib is not thread safe,
+ * so the sessions are only connected from the main loop; the host thread
+ * waits for the result. If no thread runs the loop yet, the call runs
+ * right away in the host thread. The host must not hold a display buffer
+ * locked meanwhile, the main loop may be waiting for it.
+ */
+typedef struct {
+    GlueSession *session;
+    int16_t     (*func)(GlueSession *session, gpointer data);
+    gpointer    data;
+    int16_t     result;
+    gboolean    done;
+    GMutex      lock;
+    GCond       cond;
+} SessionCall;
+
+static gboolean run_session_call(gpointer data)
 {
-    mainloop = g_main_loop_new(NULL, false);
-    g_main_loop_run(mainloop);
+    SessionCall *call = data;
+    int16_t result = call->func(call->session, call->data);
+
+    g_mutex_lock(&call->lock);
+    call->result = result;
+    call->done = TRUE;
+    g_cond_signal(&call->cond);
+    g_mutex_unlock(&call->lock);
+    return G_SOURCE_REMOVE;
 }
 
-void SpiceGlibGlue_Disconnect(void)
+static int16_t session_call(GlueSession *session,
+			    int16_t (*func)(GlueSession *session, gpointer data),
+			    gpointer data)
 {
-    SPICE_DEBUG("SpiceGlibGlue_Disconnect\n");
-    connection_disconnect(mainconn);
-    global_disconnecting = 1;
+    SessionCall call = { session, func, data, 0, FALSE };
+
+    g_mutex_init(&call.lock);
+    g_cond_init(&call.cond);
+    g_main_context_invoke(NULL, run_session_call, &call);
+    g_mutex_lock(&call.lock);
+    while (!call.done)
+	g_cond_wait(&call.cond, &call.lock);
+    g_mutex_unlock(&call.lock);
+    g_cond_clear(&call.cond);
+    g_mutex_clear(&call.lock);
+    return call.result;
 }
 
-int16_t SpiceGlibGlue_Connect(char* host,
-			      char* port, char* tls_port, char* ws_port,
-			      char* password,
-			      char* ca_file, char* cert_subj,
-			      int32_t enable_sound)
+static gboolean session_disconnect(gpointer data)
 {
+    GlueSession *session = data;
+
+    if (session->conn != NULL)
+	connection_disconnect(session->conn);
+    session->disconnecting = 1;
+    g_atomic_int_set(&session->disconnect_pending, FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+/* Disconnects from the main loop without waiting for it, so that it can
+ * be called at any time, i.e. with a display buffer locked */
+static void session_disconnect_later(GlueSession *session)
+{
+    g_atomic_int_set(&session->disconnect_pending, TRUE);
+    g_main_context_invoke(NULL, session_disconnect, session);
+}
+
+/* Connects with the arguments saved in session->params */
+static int16_t session_connect(GlueSession *session)
+{
+    GlueConnectParams *params = &session->params;
+    SpiceSession *last_session = session->spice_session;
     int result = 0;
-    global_disconnecting = 0;
-    soundEnabled = enable_sound;
 
-    SPICE_DEBUG("SpiceClientConnect session_setup");
+    session->disconnecting = 0;
+    session->sound_enabled = params->enable_sound;
 
-    mainconn = connection_new();
-    spice_session_setup(mainconn->session, host,
-			port, tls_port, ws_port,
-			password,
-			ca_file, cert_subj);
+    SPICE_DEBUG("SpiceClientConnect session_setup");
 
+    glue_timeline_start(&session->timeline);
+    session->conn = connection_new(session);
+    /* A reconnection gets the configured SpiceSession of the last one
+     * back, unless that connection is still going away */
+    if (session->conn->session != last_session) {
+	spice_session_setup(session->conn->session, params->host,
+			    params->port, params->tls_port, params->ws_port,
+			    params->password,
+			    params->ca_file, params->cert_subj);
 #if defined(PRINTING) || defined(SSO)
-    flexvdi_port_register_session(mainconn->session);
+	flexvdi_port_register_session(session->conn->session);
 #endif
+    }
+    glue_timeline_step(&session->timeline, GLUE_CONNECT_SESSION_SETUP);
+
 #if defined(PRINTING)
     onConnectGuestFollowMePrinting();
 #endif
 
     SPICE_DEBUG("SpiceClientConnect connection_connect");
 
-    connection_connect(mainconn);
-    if (connections < 0) {
+    connection_connect(session->conn);
+    if (session->connections < 0) {
     	SPICE_DEBUG("Wrong hostname, port, or password.");
         result = 2;
     }
@@ -191,34 +261,227 @@ int16_t SpiceGlibGlue_Connect(char* host,
     return result;
 }
 
-extern volatile gboolean invalidated;
-extern volatile gint invalidate_x;
-extern volatile gint invalidate_y;
-extern volatile gint invalidate_w;
-extern volatile gint invalidate_h;
+/* Arguments of SpiceGlibGlue_Connect(), until the main loop saves them */
+typedef struct {
+    char *host, *port, *tls_port, *ws_port;
+    char *password, *ca_file, *cert_subj;
+    int32_t enable_sound;
+} ConnectArgs;
+
+static int16_t session_connect_args(GlueSession *session, gpointer data)
+{
+    ConnectArgs *args = data;
+
+    /* The SpiceSession of the last server is not reused */
+    if (session->spice_session != NULL) {
+	g_object_unref(session->spice_session);
+	session->spice_session = NULL;
+    }
+    glue_session_save_params(session, args->host, args->port, args->tls_port,
+			     args->ws_port, args->password, args->ca_file,
+			     args->cert_subj, args->enable_sound);
+    /* The surfaces of the previous server must not be restored */
+    session->server_generation++;
+    return session_connect(session);
+}
+
+static int16_t session_connect_to(GlueSession *session, char* host,
+				  char* port, char* tls_port, char* ws_port,
+				  char* password,
+				  char* ca_file, char* cert_subj,
+				  int32_t enable_sound)
+{
+    ConnectArgs args = { host, port, tls_port, ws_port,
+			 password, ca_file, cert_subj, enable_sound };
+
+    return session_call(session, session_connect_args, &args);
+}
+
+static int16_t session_reconnect_saved(GlueSession *session, gpointer data)
+{
+    if (session->params.host == NULL)
+	return -1;
+    return session_connect(session);
+}
+
+static int16_t session_reconnect(GlueSession *session)
+{
+    SPICE_DEBUG("SpiceClientReconnect");
+
+    return session_call(session, session_reconnect_saved, NULL);
+}
+
+void SpiceGlibGlue_MainLoop(void)
+{
+    if (mainloop == NULL)
+	mainloop = g_main_loop_new(NULL, false);
+    g_main_loop_run(mainloop);
+}
+
+/**
+ * Starts the disconnection and returns without waiting for it; the
+ * session is disconnected when SpiceGlibGlue_isConnected() returns 0.
+ **/
+void SpiceGlibGlue_Disconnect(void)
+{
+    SPICE_DEBUG("SpiceGlibGlue_Disconnect\n");
+    session_disconnect_later(glue_session_default());
+}
+
+int16_t SpiceGlibGlue_Connect(char* host,
+			      char* port, char* tls_port, char* ws_port,
+			      char* password,
+			      char* ca_file, char* cert_subj,
+			      int32_t enable_sound)
+{
+    return session_connect_to(glue_session_default(), host, port, tls_port, ws_port,
+			      password, ca_file, cert_subj, enable_sound);
+}
+
+/**
+ * Connects again to the server of the last SpiceGlibGlue_Connect(), with
+ * the same arguments, i.e. after a network failure. Until the server
+ * repaints them, each display shows the last contents of its primary
+ * surface, if it keeps the same size.
+ * Returns -1 if there has been no connection yet, otherwise the same as
+ * SpiceGlibGlue_Connect().
+ **/
+int16_t SpiceGlibGlue_Reconnect(void)
+{
+    return session_reconnect(glue_session_default());
+}
+
+/*
+ * Sessions. The functions above act on the default session. The host can
+ * open more sessions, i.e. to warm a second connection up while the first
+ * one is alive, or to run several headless sessions in one process. Each
+ * one has its own display pipelines and connection. spice-glib attaches its
+ * sources to the default main context, so all sessions are dispatched by
+ * the same main loop, SpiceGlibGlue_MainLoop(), in one thread. The global settings (frame rate,
+ * export mode, scaling...) and the statistics are shared by all sessions,
+ * and the functions without a session handle only see the default one.
+ */
+
+/**
+ * Creates a new session, not connected yet.
+ * Returns an opaque handle for the SpiceGlibGlueSession* functions.
+ **/
+GlueSession *SpiceGlibGlueSessionNew(void)
+{
+    SPICE_DEBUG("SpiceGlibGlueSessionNew");
+
+    return glue_session_new();
+}
+
+/**
+ * Frees a session created with SpiceGlibGlueSessionNew().
+ * Returns -1 if it is still connected (see SpiceGlibGlueSessionIsConnected())
+ * or its disconnection has not run yet, 0 otherwise.
+ **/
+int16_t SpiceGlibGlueSessionFree(GlueSession *session)
+{
+    SPICE_DEBUG("SpiceGlibGlueSessionFree");
+
+    if (session == NULL || session == glue_session_default())
+	return -1;
+    if (session->connections > 0 || g_atomic_int_get(&session->disconnect_pending))
+	return -1;
+
+    glue_session_free(session);
+    return 0;
+}
+
+/* Like SpiceGlibGlue_Connect(), for the given session */
+int16_t SpiceGlibGlueSessionConnect(GlueSession *session, char* host,
+				    char* port, char* tls_port, char* ws_port,
+				    char* password,
+				    char* ca_file, char* cert_subj,
+				    int32_t enable_sound)
+{
+    return session_connect_to(session, host, port, tls_port, ws_port,
+			      password, ca_file, cert_subj, enable_sound);
+}
+
+/* Like SpiceGlibGlue_Reconnect(), for the given session */
+int16_t SpiceGlibGlueSessionReconnect(GlueSession *session)
+{
+    return session_reconnect(session);
+}
+
+/* Like SpiceGlibGlue_Disconnect(), for the given session */
+void SpiceGlibGlueSessionDisconnect(GlueSession *session)
+{
+    SPICE_DEBUG("SpiceGlibGlueSessionDisconnect");
+    session_disconnect_later(session);
+}
+
+int16_t SpiceGlibGlueSessionIsConnected(GlueSession *session)
+{
+    return session->connections > 0;
+}
+
+static int16_t get_connect_timeline(GlueSession *session,
+				    MonoGlueConnectTimeline *timeline)
+{
+    glue_timeline_get(&session->timeline, timeline);
+    return timeline->started != 0 ? 0 : -1;
+}
+
+/**
+ * Gets the time taken by each step of the last connection, to find out
+ * where a slow login spends its time. The steps are also logged as they
+ * happen, at debug level.
+ * Params:
+ *  timeline: OUT: the steps and channels of the connection, in microseconds
+ *  since it started (see MonoGlueConnectTimeline). Steps not reached yet
+ *  are -1.
+ * Returns: -1 if there has been no connection, 0 otherwise.
+ **/
+int16_t SpiceGlibGlueGetConnectTimeline(MonoGlueConnectTimeline *timeline)
+{
+    return get_connect_timeline(glue_session_default(), timeline);
+}
 
-typedef unsigned int Color32;
-static inline Color32 ARGBtoABGR(Color32 x)
+int16_t SpiceGlibGlueSessionGetConnectTimeline(GlueSession *session,
+					       MonoGlueConnectTimeline *timeline)
 {
-    return 0xFF000000 |              // ______AA
-	((x & 0x00FF0000) >> 16) |   // ____RR__
-        (x & 0x0000FF00) |           // __GG____
-        ((x & 0x000000FF) <<  16 );  // BB______
+    return get_connect_timeline(session, timeline);
 }
 
-uint32_t *glue_display_buffer = NULL; 
-gboolean updatedDisplayBuffer = FALSE;
+/*
+ * Settings written by the host from its own threads and read by the main
+ * loop and the conversion threads. They are only accessed with
+ * g_atomic_int_get() and g_atomic_int_set().
+ */
+
+/* Drop the damage of tiles whose pixels have not changed */
+volatile gint glue_tile_hashing = FALSE;
+
+/* Scaling settings given to new displays, see SpiceGlibGlueSetScaling() */
+volatile gint glue_allow_scaling = FALSE;
+volatile gint glue_only_downscale = TRUE;
+volatile gint glue_zoom_level = 100;
+
+/* Minimum time between two copies to the host, in microseconds */
+volatile gint glue_frame_interval = 30000;
 
-/* MUTEX to ensure that glue_display_buffer is not freed while it's being written */
-STATIC_MUTEX  glue_display_lock;
+/* Minimum time between two motion messages to the guest, in microseconds.
+ * 0 sends every motion event as soon as it arrives */
+volatile gint glue_motion_interval = 0;
 
-/* Size of the image stored in glue_display_buffer */
-int32_t glue_width = 0;
-int32_t glue_height = 0;
+/* Follow input events until their response is published, see
+ * SpiceGlibGlueSetInputTracing() */
+volatile gint glue_input_tracing = FALSE;
 
-/* Copy of the size of d->data the last time invalidate() was called */
-int32_t local_width = 0;
-int32_t local_height = 0;
+/* A GlueDisplayExportMode */
+volatile gint glue_export_mode = GLUE_DISPLAY_EXPORT_COPY;
+
+/* A GlueDisplayOrigin */
+#if defined(__APPLE__) || defined(ANDROID)
+volatile gint glue_display_origin = GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT;
+#else
+volatile gint glue_display_origin = GLUE_DISPLAY_ORIGIN_TOP_LEFT;
+#endif
 
 void SpiceGlibGlueInitializeGlue()
 {
@@ -228,108 +491,860 @@ void SpiceGlibGlueInitializeGlue()
 #ifdef SSO
     initializeSSO();
 #endif
-    STATIC_MUTEX_INIT(glue_display_lock);
+    glue_session_init_default();
+    glue_pixels_init();
+    glue_stripes_init();
+    glue_stats_init();
+    glue_notify_init();
+}
+
+/*
+ * Each guest monitor has its own display pipeline: buffer, damage, frames
+ * and copy schedule. The functions ending in For take the display channel
+ * and the monitor of the pipeline, from 0 to 3, and return -1 if they are
+ * out of range. The other ones act on channel 0, monitor 0. Guests with a
+ * display channel per monitor (i.e. Windows with one QXL device per head)
+ * get one pipeline per channel, on monitor 0. Guests with several monitors
+ * on one channel get one pipeline per monitor, each with its area of the
+ * primary surface as reported by the monitors config of the channel.
+ */
+
+/* Pipeline of the functions without a channel id */
+static GluePipeline *default_pipeline(void)
+{
+    return glue_pipeline_get(0, 0);
 }
 
+static gboolean resume_pipeline_copy(gpointer data)
+{
+    GluePipeline *p = data;
+
+    if (p->display != NULL)
+	spice_display_resume_copy(p->display);
+    return G_SOURCE_REMOVE;
+}
+
+/* Lets a copy that was waiting for the host buffers run again. The display
+ * of the pipeline is only touched from the main loop of its session */
+static void resume_copy(GluePipeline *p)
+{
+    g_main_context_invoke(NULL, resume_pipeline_copy, p);
+}
+
+static void resume_copy_func(gpointer data, gpointer user_data)
+{
+    resume_copy(data);
+}
+
+/* It must not be called with the display buffer locked */
+static void set_display_buffer(GluePipeline *p, uint32_t *display_buffer,
+			       int32_t width, int32_t height)
+{
+    g_mutex_lock(&p->lock);
+    p->buffer = display_buffer;
+    p->buffer_width = width;
+    p->buffer_height = height;
+    /* Its contents are unknown, the next copy is of the whole frame */
+    p->copied_width = p->copied_height = 0;
+    g_mutex_unlock(&p->lock);
+    resume_copy(p);
+}
 
 void SpiceGlibGlueSetDisplayBuffer(uint32_t *display_buffer,
 				   int32_t width, int32_t height)
 {
     SPICE_DEBUG("SpiceGlibGlueSetDisplayBuffer");
 
-    glue_display_buffer = display_buffer;
-    glue_width = width;
-    glue_height = height;
+    set_display_buffer(default_pipeline(), display_buffer, width, height);
+}
+
+int16_t SpiceGlibGlueSetDisplayBufferFor(int32_t channel_id, int32_t monitor_id,
+					 uint32_t *display_buffer,
+					 int32_t width, int32_t height)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    SPICE_DEBUG("SpiceGlibGlueSetDisplayBufferFor %d:%d", channel_id, monitor_id);
+
+    if (p == NULL)
+	return -1;
+    set_display_buffer(p, display_buffer, width, height);
+    return 0;
+}
+
+/**
+ * Sets the maximum rate at which the display is copied to the host buffer.
+ * Params: fps
+ *  Frames per second, i.e. 30, 60 or 120. 0 or less copies the display as
+ *  soon as the damage arrives.
+ * No timer is armed while there is no pending damage.
+ **/
+void SpiceGlibGlueSetFrameRate(int32_t fps)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetFrameRate %d", fps);
+
+    g_atomic_int_set(&glue_frame_interval, fps > 0 ? G_USEC_PER_SEC / fps : 0);
+}
+
+/**
+ * Coalesces the motion events of the host, so that at most rate motion
+ * messages per second are sent to the guest. In server mouse mode the
+ * relative motion is accumulated, in client mode only the last position is
+ * sent. Pending motion is sent before any button, key or scroll event, and
+ * when the button state changes.
+ * Params: rate
+ *  Motion messages per second, i.e. 60 or 125. 0 or less sends every event
+ *  (the default).
+ **/
+void SpiceGlibGlueSetMotionRate(int32_t rate)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetMotionRate %d", rate);
+
+    g_atomic_int_set(&glue_motion_interval, rate > 0 ? G_USEC_PER_SEC / rate : 0);
+}
+
+/**
+ * Measures the latency of motion and key events, from the moment they enter
+ * the glue until they are sent to the guest, until the guest damages the
+ * display around the pointer (anywhere for keys), and until that damage is
+ * published to the host. Only one event per display is followed at a time.
+ * The results are in SpiceGlibGlueGetInputStats().
+ * Params: enabled
+ *  Disabled by default.
+ **/
+void SpiceGlibGlueSetInputTracing(int16_t enabled)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetInputTracing %d", enabled);
+
+    g_atomic_int_set(&glue_input_tracing, enabled != 0);
+}
+
+/**
+ * Sets the number of threads used to convert big display updates, including
+ * the GLib main loop thread. 1 disables parallel conversion.
+ * 0 or less restores the default, half the physical cores.
+ **/
+void SpiceGlibGlueSetConversionThreads(int32_t n_threads)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetConversionThreads %d", n_threads);
+
+    if (n_threads <= 0)
+	glue_stripes_init();
+    else
+	glue_stripes_set_threads(n_threads);
+}
+
+/**
+ * Enables the detection of display updates that do not change any pixel.
+ * The damaged 64x64 tiles of the primary surface are hashed before each
+ * copy, and those with the same hash as the last time are dropped from
+ * the damage, so neither the glue nor the host copy them again. It costs
+ * a read of the damaged tiles, so it is disabled by default.
+ * The suppressed tiles are reported by SpiceGlibGlueGetDisplayStats().
+ **/
+void SpiceGlibGlueSetTileHashing(int16_t enabled)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetTileHashing %d", enabled);
+
+    g_atomic_int_set(&glue_tile_hashing, enabled != 0);
+}
+
+/**
+ * Lets the glue downscale the display while copying it, so that a big guest
+ * display fits in a smaller host buffer (and texture). Only used in
+ * GLUE_DISPLAY_EXPORT_COPY mode; the copy never upscales.
+ * Params:
+ *  allow_scaling: when it is 0 (default), frames are copied at 1:1 and
+ *  the buffer set with SpiceGlibGlueSetDisplayBuffer() must be big enough.
+ *  Otherwise they are downscaled to fit in it, keeping the aspect ratio.
+ *  only_downscale: do not ask the guest for a display smaller than the
+ *  window in SpiceGlibRecalcGeometry() when zoom_level is above 100.
+ *  zoom_level: percentage, from 10 to 400. Below 100 frames are also
+ *  downscaled by this factor, and SpiceGlibRecalcGeometry() asks the guest
+ *  for a display of the window size divided by it.
+ * Returns 0 on success, -1 if zoom_level is out of range.
+ * The size of the copied frame is returned by SpiceGlibGlueLockDisplayBuffer().
+ * It applies to all the monitors of all the sessions.
+ **/
+int16_t SpiceGlibGlueSetScaling(int16_t allow_scaling, int16_t only_downscale,
+				int32_t zoom_level)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetScaling %d %d %d",
+		allow_scaling, only_downscale, zoom_level);
+
+    if (zoom_level < 10 || zoom_level > 400)
+	return -1;
+
+    /* The displays of every session read them on each frame */
+    g_atomic_int_set(&glue_allow_scaling, allow_scaling != 0);
+    g_atomic_int_set(&glue_only_downscale, only_downscale != 0);
+    g_atomic_int_set(&glue_zoom_level, zoom_level);
+    /* Frames that did not fit in the host buffer may fit now */
+    glue_sessions_foreach_pipeline(resume_copy_func, NULL);
+    return 0;
+}
+
+/**
+ * Sets the row order of the display buffers written by the glue. Hosts that
+ * can draw top-down images should use GLUE_DISPLAY_ORIGIN_TOP_LEFT, so that
+ * the copy is a straight streaming write. It must be called before
+ * connecting, areas already copied are not flipped.
+ * Params: origin
+ *  GLUE_DISPLAY_ORIGIN_TOP_LEFT (default except on Apple and Android) or
+ *  GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT.
+ * Returns 0 on success, -1 if origin is unknown.
+ **/
+int16_t SpiceGlibGlueSetDisplayOrigin(int32_t origin)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetDisplayOrigin %d", origin);
+
+    if (origin != GLUE_DISPLAY_ORIGIN_TOP_LEFT &&
+	origin != GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT)
+	return -1;
+
+    g_atomic_int_set(&glue_display_origin, origin);
+    return 0;
+}
+
+static void get_display_layout(GluePipeline *p, int32_t *origin, int32_t *stride)
+{
+    *origin = g_atomic_int_get(&glue_display_origin);
+    *stride = p->frame_width * sizeof(uint32_t);
+    if (*origin == GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT)
+	*stride = -*stride;
+}
+
+/**
+ * Gets the layout of the display buffers written by the glue.
+ * Params:
+ *  OUT: *origin: GLUE_DISPLAY_ORIGIN_TOP_LEFT or GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT.
+ *  OUT: *stride: bytes from the start of a display row to the start of the
+ *  row below it. It is negative when the buffer is bottom-up, in which case
+ *  the top row is the last one in memory.
+ **/
+void SpiceGlibGlueGetDisplayLayout(int32_t *origin, int32_t *stride)
+{
+    get_display_layout(default_pipeline(), origin, stride);
+}
+
+int16_t SpiceGlibGlueGetDisplayLayoutFor(int32_t channel_id, int32_t monitor_id,
+					 int32_t *origin, int32_t *stride)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    if (p == NULL)
+	return -1;
+    get_display_layout(p, origin, stride);
+    return 0;
+}
+
+/**
+ * Selects how new frames are handed to the host, for all the monitors.
+ * Params: mode
+ *  GLUE_DISPLAY_EXPORT_COPY (default): frames are converted to ABGR into the
+ *  buffer set with SpiceGlibGlueSetDisplayBuffer().
+ *  GLUE_DISPLAY_EXPORT_SURFACE: frames are not copied; the host reads the
+ *  primary surface with SpiceGlibGlueLockDisplaySurface() and uploads it itself.
+ *  GLUE_DISPLAY_EXPORT_TRIPLE_BUFFER: frames are converted to ABGR into three
+ *  buffers owned by the glue; the host takes the latest one with
+ *  SpiceGlibGlueAcquireDisplayFrame(), which never waits for the copy.
+ *  GLUE_DISPLAY_EXPORT_SHARED_MEMORY: frames are converted to ABGR into
+ *  the segment created with SpiceGlibGlueCreateSharedFrames(), so that
+ *  another process can read them without copying them again.
+ * Returns 0 on success, -1 if the mode is unknown.
+ * A copy already running finishes in the previous mode.
+ **/
+int16_t SpiceGlibGlueSetDisplayExportMode(int32_t mode)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetDisplayExportMode %d", mode);
+
+    if (mode != GLUE_DISPLAY_EXPORT_COPY && mode != GLUE_DISPLAY_EXPORT_SURFACE &&
+	mode != GLUE_DISPLAY_EXPORT_TRIPLE_BUFFER &&
+	mode != GLUE_DISPLAY_EXPORT_SHARED_MEMORY)
+	return -1;
+
+    g_atomic_int_set(&glue_export_mode, mode);
+    glue_sessions_foreach_pipeline(resume_copy_func, NULL);
+    return 0;
+}
+
+typedef struct {
+    GluePipeline *taken;
+    gboolean     found;
+} NewFrameSearch;
+
+static void find_new_frame(gpointer data, gpointer user_data)
+{
+    GluePipeline *p = data;
+    NewFrameSearch *search = user_data;
+
+    if (p != search->taken &&
+	(g_atomic_int_get(&p->updated) ||
+	 glue_triple_buffer_has_new_frame(&p->triple_buffer)))
+	search->found = TRUE;
+}
+
+/* Makes the notification fd not readable before the host looks for a new
+ * frame of p. The fd is shared by all the pipelines, so it is signalled
+ * again if another one has a frame the host has not taken yet; it is
+ * checked after the clear, so that a frame published meanwhile is not lost */
+static void clear_frame_notify(GluePipeline *p)
+{
+    NewFrameSearch search = { p, FALSE };
+
+    glue_notify_clear();
+    glue_sessions_foreach_pipeline(find_new_frame, &search);
+    if (search.found)
+	glue_notify_signal();
+}
+
+/* Hands the damage published since the last lock to SpiceGlibGlueGetDirtyRects().
+ * Called with the pipeline lock held.
+ * Returns 1 if a new frame has been published, 0 otherwise. */
+static int16_t take_published_frame(GluePipeline *p)
+{
+    clear_frame_notify(p);
+    if (p->updated) {
+	g_atomic_int_set(&p->updated, FALSE);
+	glue_stats_frame_picked_up(g_get_monotonic_time());
+	pixman_region32_copy(&p->locked_region, &p->published_region);
+	pixman_region32_clear(&p->published_region);
+	return 1;
+    }
+    pixman_region32_clear(&p->locked_region);
+    return 0;
+}
+
+static int16_t lock_display_buffer(GluePipeline *p, int32_t *width, int32_t *height)
+{
+    g_mutex_lock(&p->lock);
+
+    *width = p->frame_width;
+    *height = p->frame_height;
+
+    return take_published_frame(p);
 }
 
 /** 
- * Locks the glue_display_buffer, so that we can safely call
+ * Locks the display buffer, so that we can safely call
  * SpiceGlibGlueSetDisplayBuffer()
  * Params: *width, *height
  *  IN: don't care
- *  OUT: size of display used by the spice-client-lib: Real guest display, and what the
+ *  OUT: size of the image in the display buffer: the guest display, or smaller
+ *  when it is downscaled (see SpiceGlibGlueSetScaling()).
  * Returns true if current buffer has changed and has not been copied, false otherwise.
  **/
 int16_t SpiceGlibGlueLockDisplayBuffer(int32_t *width, int32_t *height)
 {
     SPICE_DEBUG("SpiceGlibGlueLockDisplayBuffer");
 
-    STATIC_MUTEX_LOCK(glue_display_lock);
+    return lock_display_buffer(default_pipeline(), width, height);
+}
 
-    *width = local_width;
-    *height = local_height;
+void SpiceGlibGlueUnlockDisplayBuffer()
+{
+    SPICE_DEBUG("SpiceGlibGlueUnlockDisplayBuffer");
+
+    g_mutex_unlock(&default_pipeline()->lock);
+}
 
-    if (updatedDisplayBuffer) {
-    	updatedDisplayBuffer = FALSE;
-    	return 1;
+/* Unless -1 is returned, it must be unlocked with SpiceGlibGlueUnlockDisplayBufferFor() */
+int16_t SpiceGlibGlueLockDisplayBufferFor(int32_t channel_id, int32_t monitor_id,
+					  int32_t *width, int32_t *height)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    if (p == NULL)
+	return -1;
+    return lock_display_buffer(p, width, height);
+}
+
+void SpiceGlibGlueUnlockDisplayBufferFor(int32_t channel_id, int32_t monitor_id)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    if (p != NULL)
+	g_mutex_unlock(&p->lock);
+}
+
+static int32_t get_dirty_rects(GluePipeline *p, MonoGlueRect *rects, int32_t max_rects)
+{
+    GlueDisplayOrigin origin = g_atomic_int_get(&glue_display_origin);
+    pixman_box32_t *boxes;
+    int i, n_boxes;
+
+    if (max_rects <= 0)
+	return 0;
+
+    boxes = pixman_region32_rectangles(&p->locked_region, &n_boxes);
+    if (n_boxes > max_rects) {
+	boxes = pixman_region32_extents(&p->locked_region);
+	n_boxes = 1;
+    }
+
+    for (i = 0; i < n_boxes; i++) {
+	rects[i].x = boxes[i].x1;
+	rects[i].width = boxes[i].x2 - boxes[i].x1;
+	rects[i].height = boxes[i].y2 - boxes[i].y1;
+	if (origin == GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT)
+	    rects[i].y = p->frame_height - boxes[i].y2;
+	else
+	    rects[i].y = boxes[i].y1;
     }
+    return n_boxes;
+}
+
+/**
+ * Gets the rectangles of the display that have changed since the previous
+ * lock, so that the host only uploads them. It must be called between
+ * SpiceGlibGlueLockDisplayBuffer() (or SpiceGlibGlueLockDisplaySurface())
+ * and the corresponding unlock.
+ * Params:
+ *  OUT: rects: array of at least max_rects rectangles, in the coordinates of
+ *  the display buffer (bottom-up with GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT).
+ *  IN: max_rects: size of rects.
+ * Returns the number of rectangles stored in rects. If there are more than
+ * max_rects, their bounding box is returned as a single rectangle.
+ * Not available in GLUE_DISPLAY_EXPORT_TRIPLE_BUFFER mode.
+ **/
+int32_t SpiceGlibGlueGetDirtyRects(MonoGlueRect *rects, int32_t max_rects)
+{
+    return get_dirty_rects(default_pipeline(), rects, max_rects);
+}
+
+int32_t SpiceGlibGlueGetDirtyRectsFor(int32_t channel_id, int32_t monitor_id,
+				      MonoGlueRect *rects, int32_t max_rects)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    if (p == NULL)
+	return -1;
+    return get_dirty_rects(p, rects, max_rects);
+}
+
+/* Like the For functions above, for a monitor of the given session */
+
+int16_t SpiceGlibGlueSessionSetDisplayBuffer(GlueSession *session,
+					     int32_t channel_id, int32_t monitor_id,
+					     uint32_t *display_buffer,
+					     int32_t width, int32_t height)
+{
+    GluePipeline *p = glue_session_get_pipeline(session, channel_id, monitor_id);
+
+    if (p == NULL)
+	return -1;
+    set_display_buffer(p, display_buffer, width, height);
     return 0;
 }
 
-void SpiceGlibGlueUnlockDisplayBuffer()
+/* Unless -1 is returned, it must be unlocked with SpiceGlibGlueSessionUnlockDisplayBuffer() */
+int16_t SpiceGlibGlueSessionLockDisplayBuffer(GlueSession *session,
+					      int32_t channel_id, int32_t monitor_id,
+					      int32_t *width, int32_t *height)
 {
-    SPICE_DEBUG("SpiceGlibGlueUnlockDisplayBuffer");
+    GluePipeline *p = glue_session_get_pipeline(session, channel_id, monitor_id);
 
-    STATIC_MUTEX_UNLOCK(glue_display_lock);
+    if (p == NULL)
+	return -1;
+    return lock_display_buffer(p, width, height);
 }
 
-int16_t SpiceGlibGlueGetCursorPosition(int32_t* x, int32_t* y)
+void SpiceGlibGlueSessionUnlockDisplayBuffer(GlueSession *session,
+					     int32_t channel_id, int32_t monitor_id)
 {
-    SpiceDisplayPrivate *d;
+    GluePipeline *p = glue_session_get_pipeline(session, channel_id, monitor_id);
 
-    if (global_display == NULL) {
+    if (p != NULL)
+	g_mutex_unlock(&p->lock);
+}
+
+int32_t SpiceGlibGlueSessionGetDirtyRects(GlueSession *session,
+					  int32_t channel_id, int32_t monitor_id,
+					  MonoGlueRect *rects, int32_t max_rects)
+{
+    GluePipeline *p = glue_session_get_pipeline(session, channel_id, monitor_id);
+
+    if (p == NULL)
 	return -1;
+    return get_dirty_rects(p, rects, max_rects);
+}
+
+static int16_t lock_display_surface(GluePipeline *p, const void **data,
+				    int32_t *width, int32_t *height,
+				    int32_t *stride, int32_t *format,
+				    uint32_t *sequence)
+{
+    SpiceDisplayPrivate *d = NULL;
+
+    g_mutex_lock(&p->lock);
+
+    if (p->display != NULL)
+	d = SPICE_DISPLAY_GET_PRIVATE(p->display);
+
+    if (d == NULL || d->data == NULL) {
+	*data = NULL;
+	*width = *height = *stride = *format = 0;
+    } else {
+	*data = d->data;
+	*width = d->width;
+	*height = d->height;
+	*stride = d->stride;
+	*format = d->format;
     }
+    *sequence = p->frame_sequence;
+
+    return take_published_frame(p);
+}
 
-    d = SPICE_DISPLAY_GET_PRIVATE(global_display);
+/**
+ * Locks the primary surface and gives read-only access to it, in
+ * GLUE_DISPLAY_EXPORT_SURFACE mode. The surface is not destroyed nor
+ * replaced until SpiceGlibGlueUnlockDisplaySurface() is called.
+ * Params:
+ *  OUT: *data: first row of the surface, NULL if there is no surface yet.
+ *  OUT: *width, *height: size of the surface, in pixels.
+ *  OUT: *stride: bytes between two consecutive rows.
+ *  OUT: *format: SpiceSurfaceFmt of the pixels (i.e. SPICE_SURFACE_FMT_32_xRGB).
+ *  OUT: *sequence: number of the last published frame.
+ * Returns 1 if a new frame has been published since the last lock, 0 otherwise.
+ * Note that the surface is written by the spice decoders, which do not take
+ * the lock, so the host may see a frame being updated.
+ **/
+int16_t SpiceGlibGlueLockDisplaySurface(const void **data,
+					int32_t *width, int32_t *height,
+					int32_t *stride, int32_t *format,
+					uint32_t *sequence)
+{
+    return lock_display_surface(default_pipeline(), data, width, height,
+				stride, format, sequence);
+}
 
-    if (d->data == NULL) {
-	//SPICE_DEBUG("d->data == NULL");
+void SpiceGlibGlueUnlockDisplaySurface()
+{
+    g_mutex_unlock(&default_pipeline()->lock);
+}
+
+/* Unless -1 is returned, it must be unlocked with SpiceGlibGlueUnlockDisplaySurfaceFor() */
+int16_t SpiceGlibGlueLockDisplaySurfaceFor(int32_t channel_id, int32_t monitor_id,
+					   const void **data,
+					   int32_t *width, int32_t *height,
+					   int32_t *stride, int32_t *format,
+					   uint32_t *sequence)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    if (p == NULL)
 	return -1;
-    }
+    return lock_display_surface(p, data, width, height, stride, format, sequence);
+}
 
-    *x=d->mouse_guest_x;
-    *y=d->mouse_guest_y;
+void SpiceGlibGlueUnlockDisplaySurfaceFor(int32_t channel_id, int32_t monitor_id)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
 
-    return 0;
+    if (p != NULL)
+	g_mutex_unlock(&p->lock);
+}
+
+static int16_t acquire_display_frame(GluePipeline *p, uint32_t **buffer,
+				     int32_t *width, int32_t *height,
+				     uint32_t *sequence)
+{
+    GlueFrameBuffer *front;
+    int ret;
+
+    clear_frame_notify(p);
+    ret = glue_triple_buffer_acquire(&p->triple_buffer, &front);
+    if (ret < 0)
+	return -1;
+    if (ret == 1)
+	glue_stats_frame_picked_up(g_get_monotonic_time());
+
+    *buffer = front->pixels;
+    *width = front->width;
+    *height = front->height;
+    *sequence = front->sequence;
+    return ret;
+}
+
+/**
+ * Takes the latest frame in GLUE_DISPLAY_EXPORT_TRIPLE_BUFFER mode.
+ * It never waits for copy_display_to_glue(), which keeps converting new
+ * frames into the other two buffers meanwhile.
+ * Params:
+ *  OUT: *buffer: ABGR pixels of the frame, *width pixels per row.
+ *  OUT: *width, *height: size of the frame.
+ *  OUT: *sequence: number of the frame.
+ * Returns 1 if it is a new frame, 0 if it is the same frame as the last call,
+ * -1 if no frame has been published yet. When the display is resized, the
+ * last frame of the old size is returned until one of the new size is ready.
+ * Unless -1 is returned, the buffer must be released with
+ * SpiceGlibGlueReleaseDisplayFrame(), from the same thread.
+ **/
+int16_t SpiceGlibGlueAcquireDisplayFrame(uint32_t **buffer,
+					 int32_t *width, int32_t *height,
+					 uint32_t *sequence)
+{
+    return acquire_display_frame(default_pipeline(), buffer, width, height, sequence);
 }
 
-int32_t SpiceGlibGlue_SpiceKeyEvent(int16_t isDown, int32_t hardware_keycode)
+void SpiceGlibGlueReleaseDisplayFrame()
+{
+    glue_triple_buffer_release(&default_pipeline()->triple_buffer);
+}
+
+int16_t SpiceGlibGlueAcquireDisplayFrameFor(int32_t channel_id, int32_t monitor_id,
+					    uint32_t **buffer,
+					    int32_t *width, int32_t *height,
+					    uint32_t *sequence)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    if (p == NULL)
+	return -1;
+    return acquire_display_frame(p, buffer, width, height, sequence);
+}
+
+void SpiceGlibGlueReleaseDisplayFrameFor(int32_t channel_id, int32_t monitor_id)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    if (p != NULL)
+	glue_triple_buffer_release(&p->triple_buffer);
+}
+
+static int32_t create_shared_frames(GluePipeline *p, int32_t max_width, int32_t max_height,
+				    char *name, int32_t name_size)
+{
+    gboolean created;
+
+    g_mutex_lock(&p->lock);
+    created = glue_shm_create(&p->shm, max_width, max_height);
+    if (created && name != NULL && name_size > 0)
+	g_strlcpy(name, p->shm.name, name_size);
+    g_mutex_unlock(&p->lock);
+    if (created)
+	resume_copy(p);
+
+    return created ? p->shm.fd : -1;
+}
+
+static void destroy_shared_frames(GluePipeline *p)
+{
+    g_mutex_lock(&p->lock);
+    glue_shm_destroy(&p->shm);
+    g_mutex_unlock(&p->lock);
+}
+
+/**
+ * Creates the shared memory segment of GLUE_DISPLAY_EXPORT_SHARED_MEMORY
+ * mode, replacing the previous one. Its layout and the protocol to read
+ * frames are described in glue-shm.h. Frames bigger than the maximum size
+ * are not exported until a bigger segment is created.
+ * Params:
+ *  max_width, max_height: maximum size of the frames.
+ *  OUT: name: name of the POSIX shm object to open with shm_open(), or an
+ *  empty string if the segment is a memfd, which has to be passed to the
+ *  reader process as a file descriptor (i.e. SCM_RIGHTS).
+ *  IN: name_size: size of name.
+ * Returns the fd of the segment, owned by the glue, or -1 on error (i.e.
+ * on Windows). It stays valid until the segment is replaced or destroyed.
+ * Each monitor has its own segment.
+ **/
+int32_t SpiceGlibGlueCreateSharedFrames(int32_t max_width, int32_t max_height,
+					char *name, int32_t name_size)
+{
+    SPICE_DEBUG("SpiceGlibGlueCreateSharedFrames %dx%d", max_width, max_height);
+
+    return create_shared_frames(default_pipeline(), max_width, max_height,
+				name, name_size);
+}
+
+/**
+ * Destroys the shared memory segment. Readers that have already mapped it
+ * keep their mapping, but receive no more frames.
+ **/
+void SpiceGlibGlueDestroySharedFrames()
+{
+    SPICE_DEBUG("SpiceGlibGlueDestroySharedFrames");
+
+    destroy_shared_frames(default_pipeline());
+}
+
+int32_t SpiceGlibGlueCreateSharedFramesFor(int32_t channel_id, int32_t monitor_id,
+					   int32_t max_width, int32_t max_height,
+					   char *name, int32_t name_size)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    SPICE_DEBUG("SpiceGlibGlueCreateSharedFramesFor %d:%d %dx%d",
+		channel_id, monitor_id, max_width, max_height);
+
+    if (p == NULL)
+	return -1;
+    return create_shared_frames(p, max_width, max_height, name, name_size);
+}
+
+void SpiceGlibGlueDestroySharedFramesFor(int32_t channel_id, int32_t monitor_id)
+{
+    GluePipeline *p = glue_pipeline_get(channel_id, monitor_id);
+
+    SPICE_DEBUG("SpiceGlibGlueDestroySharedFramesFor %d:%d", channel_id, monitor_id);
+
+    if (p != NULL)
+	destroy_shared_frames(p);
+}
+
+/**
+ * Registers a function to be called each time a new frame is published, so
+ * that the host does not need to poll for it. It is called from the GLib
+ * main loop thread, without any glue lock held; it should just wake up the
+ * render thread, although it may also take the frame itself. It gets the
+ * channel and monitor ids of the display with the new frame, and the
+ * sequence number of the frame.
+ * Params:
+ *  callback: function to call, NULL to stop the notifications.
+ *  user_data: passed to the callback.
+ **/
+void SpiceGlibGlueSetFrameReadyCallback(GlueFrameReadyCallback callback,
+					void *user_data)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetFrameReadyCallback");
+
+    glue_notify_set_callback(callback, user_data);
+}
+
+/**
+ * Gets a file descriptor that becomes readable when a new frame is published,
+ * to wait for frames with poll() or the host event loop. The host must not
+ * read nor close it; it is made not readable again when the frame is taken
+ * with SpiceGlibGlueLockDisplayBuffer(), SpiceGlibGlueLockDisplaySurface() or
+ * SpiceGlibGlueAcquireDisplayFrame(). With several monitors, it tells that
+ * any of them has a new frame.
+ * Returns the fd, or -1 if it is not available (i.e. on Windows).
+ **/
+int32_t SpiceGlibGlueGetFrameReadyFd()
+{
+    return glue_notify_get_fd();
+}
+
+/**
+ * Gets the statistics of the display pipeline since the last reset, to tell
+ * whether a slow session is caused by the network, the decoders or the copy.
+ * They are always collected and can be read from any thread.
+ * Params:
+ *  OUT: stats: counters, throughput and time percentiles in microseconds.
+ **/
+void SpiceGlibGlueGetDisplayStats(GlueDisplayStats *stats)
+{
+    glue_stats_get_display(stats);
+}
+
+void SpiceGlibGlueResetDisplayStats()
+{
+    SPICE_DEBUG("SpiceGlibGlueResetDisplayStats");
+
+    glue_stats_reset_display();
+}
+
+/**
+ * Gets the statistics of the input events since the last reset.
+ * Params:
+ *  OUT: stats: motion events received from the host and sent to the guest,
+ *  and the latency of the traced events in microseconds.
+ **/
+void SpiceGlibGlueGetInputStats(GlueInputStats *stats)
+{
+    glue_stats_get_input(stats);
+}
+
+void SpiceGlibGlueResetInputStats()
+{
+    SPICE_DEBUG("SpiceGlibGlueResetInputStats");
+
+    glue_stats_reset_input();
+}
+
+/* Drops the reference to display taken by the caller */
+static int16_t get_cursor_position(SpiceDisplay *display, int32_t* x, int32_t* y)
 {
-    SpiceDisplay *display;
     SpiceDisplayPrivate *d;
-    int scancode;
-    
-    display = global_display;
-    if (global_display == NULL) {
-        return -1;
+    MonoGlueCursorState state;
+    int16_t result = -1;
+
+    if (display == NULL) {
+	return -1;
     }
 
     d = SPICE_DISPLAY_GET_PRIVATE(display);
-    if (d->data == NULL) {
-        return -1;
+
+    if (d->data != NULL) {
+	/* Written by the main loop, read the published copy */
+	glue_cursor_state_read(&d->cursor_state, &state);
+	*x = state.x;
+	*y = state.y;
+	result = 0;
     }
 
-    SPICE_DEBUG("isDown= %d, hardware_keycode=%d", isDown, hardware_keycode);
+    g_object_unref(display);
+    return result;
+}
 
-    if (!d->inputs)
-    	return-1;
+int16_t SpiceGlibGlueGetCursorPosition(int32_t* x, int32_t* y)
+{
+    return get_cursor_position(glue_ref_global_display(), x, y);
+}
 
-    scancode = hardware_keycode;
-    if (isDown) {
-        send_key(display, scancode, 1);
-    } else {
-	send_key(display, scancode, 0);
+int16_t SpiceGlibGlueGetCursorPositionFor(int32_t channel_id, int32_t monitor_id,
+					  int32_t* x, int32_t* y)
+{
+    return get_cursor_position(glue_pipeline_ref_display(channel_id, monitor_id), x, y);
+}
+
+/* Drops the reference to display taken by the caller */
+static int16_t get_cursor_state(SpiceDisplay *display, MonoGlueCursorState *state)
+{
+    SpiceDisplayPrivate *d;
+
+    if (display == NULL) {
+	return -1;
     }
+
+    d = SPICE_DISPLAY_GET_PRIVATE(display);
+    glue_cursor_state_read(&d->cursor_state, state);
+    g_object_unref(display);
     return 0;
 }
 
+/**
+ * Gets the position, visibility and shape id of the guest cursor without
+ * waiting for the main loop, so that it can be polled on every host frame.
+ * Params:
+ *  OUT: state: consistent snapshot of the cursor; x and y are -1 until the
+ *  guest sends a position, cursor_id is the one SpiceGlibGlueGetCursor() returns.
+ * Returns: -1 if there is no display, 0 otherwise.
+ **/
+int16_t SpiceGlibGlueGetCursorState(MonoGlueCursorState *state)
+{
+    return get_cursor_state(glue_ref_global_display(), state);
+}
+
+int16_t SpiceGlibGlueGetCursorStateFor(int32_t channel_id, int32_t monitor_id,
+				       MonoGlueCursorState *state)
+{
+    return get_cursor_state(glue_pipeline_ref_display(channel_id, monitor_id), state);
+}
+
 int16_t SpiceGlibGlue_isConnected() {
+    int connections = glue_session_default()->connections;
+
     SPICE_DEBUG("isConnected int: %d bool: %d .", connections, (connections > 0));
     return (connections > 0);
 }
 
 int16_t SpiceGlibGlue_getNumberOfChannels() {
+    spice_connection *mainconn = glue_session_default()->conn;
+
     if (mainconn == NULL) {
         return 0;
     } else {
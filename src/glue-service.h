@@ -15,22 +15,47 @@
  * License along with this library; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef GLUE_SERVICE_H_
+#define GLUE_SERVICE_H_
+
 #include "glue-spice-widget.h"
 
 #define PTRFLAGS_DOWN 0x8000
 
+/* Maximum number of rectangles kept in a damage region before
+ * coalescing them into their bounding box */
+#define GLUE_MAX_DIRTY_RECTS 32
+
+/* How copy_display_to_glue() publishes new frames to the host */
+typedef enum {
+    /* Converted to ABGR into the buffer set with SpiceGlibGlueSetDisplayBuffer() */
+    GLUE_DISPLAY_EXPORT_COPY = 0,
+    /* Not copied, the host reads the primary surface (SpiceGlibGlueLockDisplaySurface()) */
+    GLUE_DISPLAY_EXPORT_SURFACE = 1,
+    /* Converted to ABGR into glue-owned triple buffers (SpiceGlibGlueAcquireDisplayFrame()) */
+    GLUE_DISPLAY_EXPORT_TRIPLE_BUFFER = 2,
+    /* Converted to ABGR into a shared memory segment (SpiceGlibGlueCreateSharedFrames()) */
+    GLUE_DISPLAY_EXPORT_SHARED_MEMORY = 3,
+} GlueDisplayExportMode;
+
+/* Row order of the glue display buffers */
+typedef enum {
+    /* First row in memory is the top of the display */
+    GLUE_DISPLAY_ORIGIN_TOP_LEFT = 0,
+    /* First row in memory is the bottom of the display (i.e. OpenGL textures) */
+    GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT = 1,
+} GlueDisplayOrigin;
+
 
+/* First display of the default session, see glue-session.h. The main
+ * loop changes it with global_display_lock held, other threads use
+ * glue_ref_global_display() */
 #ifdef GLUE_SERVICE_C
 SpiceDisplay*   global_display = NULL;
-gboolean  global_disconnecting = FALSE;
-GMainLoop            *mainloop = NULL;
-int                connections = 0;
-gboolean          soundEnabled = FALSE;
+GMutex          global_display_lock;
 #else
 extern SpiceDisplay*   global_display;
-extern gboolean  global_disconnecting;
-extern GMainLoop            *mainloop;
-extern int                connections;
-extern gboolean          soundEnabled;
+extern GMutex          global_display_lock;
 #endif
 
+#endif /* GLUE_SERVICE_H_ */
@@ -0,0 +1,168 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sessions: the connection and display pipelines of each spice session
+ * opened by the host.
+ */
+
+#include <string.h>
+
+#include "glue-session.h"
+#include "glue-service.h"
+
+static GlueSession default_session;
+/* The other sessions, for the settings that apply to all of them */
+static GSList *sessions;
+static GMutex sessions_lock;
+
+void glue_session_init_default(void)
+{
+    if (default_session.pipelines != NULL)
+	return;
+
+    default_session.pipelines = glue_pipelines_new();
+    glue_timeline_init(&default_session.timeline);
+}
+
+GlueSession *glue_session_default(void)
+{
+    return &default_session;
+}
+
+static void clear_params(GlueConnectParams *params)
+{
+    g_free(params->host);
+    g_free(params->port);
+    g_free(params->tls_port);
+    g_free(params->ws_port);
+    g_free(params->password);
+    g_free(params->ca_file);
+    g_free(params->cert_subj);
+    memset(params, 0, sizeof(*params));
+}
+
+GlueSession *glue_session_new(void)
+{
+    GlueSession *session = g_new0(GlueSession, 1);
+
+    session->pipelines = glue_pipelines_new();
+    glue_timeline_init(&session->timeline);
+
+    g_mutex_lock(&sessions_lock);
+    sessions = g_slist_prepend(sessions, session);
+    g_mutex_unlock(&sessions_lock);
+    return session;
+}
+
+void glue_session_free(GlueSession *session)
+{
+    if (session == NULL || session == &default_session)
+	return;
+
+    g_mutex_lock(&sessions_lock);
+    sessions = g_slist_remove(sessions, session);
+    g_mutex_unlock(&sessions_lock);
+
+    if (session->spice_session != NULL)
+	g_object_unref(session->spice_session);
+    glue_pipelines_free(session->pipelines);
+    glue_timeline_clear(&session->timeline);
+    clear_params(&session->params);
+    g_free(session);
+}
+
+void glue_session_save_params(GlueSession *session, const char *host,
+			      const char *port, const char *tls_port,
+			      const char *ws_port, const char *password,
+			      const char *ca_file, const char *cert_subj,
+			      gboolean enable_sound)
+{
+    GlueConnectParams *params = &session->params;
+
+    clear_params(params);
+    params->host = g_strdup(host);
+    params->port = g_strdup(port);
+    params->tls_port = g_strdup(tls_port);
+    params->ws_port = g_strdup(ws_port);
+    params->password = g_strdup(password);
+    params->ca_file = g_strdup(ca_file);
+    params->cert_subj = g_strdup(cert_subj);
+    params->enable_sound = enable_sound;
+}
+
+GluePipeline *glue_session_get_pipeline(GlueSession *session,
+					int32_t channel_id, int32_t monitor_id)
+{
+    return glue_pipelines_find(session->pipelines, channel_id, monitor_id);
+}
+
+SpiceDisplay *glue_session_ref_display(GlueSession *session,
+				       int32_t channel_id, int32_t monitor_id)
+{
+    GluePipeline *p = glue_session_get_pipeline(session, channel_id, monitor_id);
+    SpiceDisplay *display = NULL;
+
+    if (p == NULL)
+	return NULL;
+
+    g_mutex_lock(&p->lock);
+    if (p->display != NULL)
+	display = g_object_ref(p->display);
+    g_mutex_unlock(&p->lock);
+    return display;
+}
+
+GluePipeline *glue_pipeline_get(int32_t channel_id, int32_t monitor_id)
+{
+    return glue_session_get_pipeline(&default_session, channel_id, monitor_id);
+}
+
+SpiceDisplay *glue_pipeline_ref_display(int32_t channel_id, int32_t monitor_id)
+{
+    return glue_session_ref_display(&default_session, channel_id, monitor_id);
+}
+
+SpiceDisplay *glue_ref_global_display(void)
+{
+    SpiceDisplay *display = NULL;
+
+    g_mutex_lock(&global_display_lock);
+    if (global_display != NULL)
+	display = g_object_ref(global_display);
+    g_mutex_unlock(&global_display_lock);
+    return display;
+}
+
+static void foreach_pipeline(GlueSession *session, GFunc func, gpointer data)
+{
+    int i;
+
+    for (i = 0; session->pipelines != NULL && i < GLUE_MAX_PIPELINES; i++)
+	func(&session->pipelines[i], data);
+}
+
+void glue_sessions_foreach_pipeline(GFunc func, gpointer data)
+{
+    GSList *it;
+
+    foreach_pipeline(&default_session, func, data);
+    g_mutex_lock(&sessions_lock);
+    for (it = sessions; it != NULL; it = it->next)
+	foreach_pipeline(it->data, func, data);
+    g_mutex_unlock(&sessions_lock);
+}
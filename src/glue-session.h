@@ -0,0 +1,100 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GLUE_SESSION_H_
+#define GLUE_SESSION_H_
+
+#include <stdint.h>
+#include "glib.h"
+#include "glue-spice-widget.h"
+#include "glue-pipeline.h"
+#include "glue-timeline.h"
+
+/* Arguments of the last connection, for SpiceGlibGlue_Reconnect() */
+typedef struct {
+    gchar                   *host;
+    gchar                   *port, *tls_port, *ws_port;
+    gchar                   *password;
+    gchar                   *ca_file, *cert_subj;
+    gboolean                enable_sound;
+} GlueConnectParams;
+
+/*
+ * A spice session and everything the glue keeps for it. The functions
+ * without a session handle use the default session. All sessions run on
+ * the default main context, where spice-glib attaches its sources, and are
+ * only connected and disconnected from its main loop.
+ */
+struct _GlueSession {
+    /* Current connection, NULL if there is none */
+    struct spice_connection *conn;
+    /* Configured with params by the first connection to the server and
+     * reused by the reconnections, NULL until then */
+    SpiceSession            *spice_session;
+    /* Connections not destroyed yet */
+    int                     connections;
+    /* Disconnection requested by the host, channel errors are ignored */
+    gboolean                disconnecting;
+    /* Disconnection requested by the host and not run by the main loop yet */
+    volatile gint           disconnect_pending;
+    gboolean                sound_enabled;
+    /* GLUE_MAX_PIPELINES display pipelines */
+    GluePipeline            *pipelines;
+    /* Steps of the last connection */
+    GlueTimeline            timeline;
+    /* host is NULL until the first connection */
+    GlueConnectParams       params;
+    /* Incremented by each connection with new arguments, but not by
+     * reconnections to the same server */
+    guint                   server_generation;
+};
+
+/* Called by SpiceGlibGlueInitializeGlue() */
+void glue_session_init_default(void);
+GlueSession *glue_session_default(void);
+
+GlueSession *glue_session_new(void);
+/* The session must be disconnected */
+void glue_session_free(GlueSession *session);
+
+/* Keeps a copy of the arguments of a new connection */
+void glue_session_save_params(GlueSession *session, const char *host,
+			      const char *port, const char *tls_port,
+			      const char *ws_port, const char *password,
+			      const char *ca_file, const char *cert_subj,
+			      gboolean enable_sound);
+
+/* Return NULL if the ids are out of range */
+GluePipeline *glue_session_get_pipeline(GlueSession *session,
+					int32_t channel_id, int32_t monitor_id);
+/* New reference to the display attached to a pipeline, NULL if there is
+ * none. The host threads hold it while they use the display, since the
+ * main loop may destroy it at any time */
+SpiceDisplay *glue_session_ref_display(GlueSession *session,
+				       int32_t channel_id, int32_t monitor_id);
+
+/* Same, for the default session */
+GluePipeline *glue_pipeline_get(int32_t channel_id, int32_t monitor_id);
+SpiceDisplay *glue_pipeline_ref_display(int32_t channel_id, int32_t monitor_id);
+/* New reference to global_display, NULL if there is none */
+SpiceDisplay *glue_ref_global_display(void);
+
+/* Calls func(pipeline, data) for every pipeline of every session */
+void glue_sessions_foreach_pipeline(GFunc func, gpointer data);
+
+#endif /* GLUE_SESSION_H_ */
@@ -0,0 +1,241 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Frame buffers in a shared memory segment, for renderers running in
+ * another process. See glue-shm.h for the layout and the reader protocol.
+ */
+
+#ifdef HAVE_MEMFD_CREATE
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <spice-gtk/spice-util.h>
+
+#include "glue-shm.h"
+
+#define GLUE_SHM_PAGE_SIZE 4096
+#define ROUND_UP_PAGE(x) (((x) + GLUE_SHM_PAGE_SIZE - 1) & ~(gsize)(GLUE_SHM_PAGE_SIZE - 1))
+
+void glue_shm_init(GlueShm *shm)
+{
+    int i;
+
+    memset(shm, 0, sizeof(*shm));
+    shm->fd = -1;
+    for (i = 0; i < GLUE_SHM_SLOTS; i++) {
+	pixman_region32_init(&shm->pending[i]);
+    }
+}
+
+void glue_shm_clear(GlueShm *shm)
+{
+    int i;
+
+    glue_shm_destroy(shm);
+    for (i = 0; i < GLUE_SHM_SLOTS; i++) {
+	pixman_region32_fini(&shm->pending[i]);
+    }
+}
+
+static uint32_t *slot_pixels(GlueShm *shm, int slot)
+{
+    return (uint32_t *)((guint8 *)shm->header + shm->header->header_size +
+			(gsize)slot * shm->header->slot_size);
+}
+
+#ifndef WIN32
+static int open_segment(GlueShm *shm)
+{
+    static int counter = 0;
+    int fd;
+
+#ifdef HAVE_MEMFD_CREATE
+    fd = memfd_create("spice-glue-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd != -1) {
+	shm->name[0] = '\0';
+	return fd;
+    }
+    SPICE_DEBUG("memfd_create failed (%s), using shm_open", g_strerror(errno));
+#endif
+
+    g_snprintf(shm->name, sizeof(shm->name), "/spice-glue-%d-%d",
+	       (int)getpid(), counter++);
+    fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1)
+	shm->name[0] = '\0';
+    return fd;
+}
+#endif
+
+gboolean glue_shm_create(GlueShm *shm, int32_t max_width, int32_t max_height)
+{
+#ifdef WIN32
+    g_warning("Shared memory frames are not supported on Windows");
+    return FALSE;
+#else
+    gsize header_size = ROUND_UP_PAGE(sizeof(GlueShmHeader));
+    gsize slot_size = ROUND_UP_PAGE((gsize)max_width * max_height * sizeof(uint32_t));
+    void *base;
+
+    glue_shm_destroy(shm);
+    if (max_width <= 0 || max_height <= 0)
+	return FALSE;
+
+    shm->fd = open_segment(shm);
+    if (shm->fd == -1) {
+	g_warning("Could not create the shared frames: %s", g_strerror(errno));
+	return FALSE;
+    }
+
+    shm->size = header_size + slot_size * GLUE_SHM_SLOTS;
+    if (ftruncate(shm->fd, shm->size) == -1) {
+	g_warning("Could not size the shared frames: %s", g_strerror(errno));
+	glue_shm_destroy(shm);
+	return FALSE;
+    }
+#ifdef HAVE_MEMFD_CREATE
+    /* Readers can trust the size of the segment */
+    if (shm->name[0] == '\0')
+	fcntl(shm->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+#endif
+
+    base = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (base == MAP_FAILED) {
+	g_warning("Could not map the shared frames: %s", g_strerror(errno));
+	glue_shm_destroy(shm);
+	return FALSE;
+    }
+
+    /* ftruncate() filled it with zeros: no frame, all seqlocks even */
+    shm->header = base;
+    shm->header->magic = GLUE_SHM_MAGIC;
+    shm->header->version = GLUE_SHM_VERSION;
+    shm->header->header_size = header_size;
+    shm->header->slot_size = slot_size;
+    shm->header->n_slots = GLUE_SHM_SLOTS;
+    shm->header->max_width = max_width;
+    shm->header->max_height = max_height;
+    shm->width = shm->height = 0;
+    shm->back = 0;
+
+    SPICE_DEBUG("Created %" G_GSIZE_FORMAT " bytes of shared frames %s",
+		shm->size, shm->name);
+    return TRUE;
+#endif
+}
+
+void glue_shm_destroy(GlueShm *shm)
+{
+#ifndef WIN32
+    if (shm->header != NULL)
+	munmap(shm->header, shm->size);
+    if (shm->fd != -1)
+	close(shm->fd);
+    /* Readers that already opened it keep their mapping */
+    if (shm->name[0] != '\0')
+	shm_unlink(shm->name);
+#endif
+    shm->header = NULL;
+    shm->size = 0;
+    shm->fd = -1;
+    shm->name[0] = '\0';
+}
+
+gboolean glue_shm_resize(GlueShm *shm, int32_t width, int32_t height)
+{
+    int i;
+
+    if (shm->header == NULL || width <= 0 || height <= 0 ||
+	(gsize)width * height * sizeof(uint32_t) > shm->header->slot_size)
+	return FALSE;
+
+    if (shm->width == width && shm->height == height)
+	return TRUE;
+
+    for (i = 0; i < GLUE_SHM_SLOTS; i++) {
+	pixman_region32_reset(&shm->pending[i],
+			      &(pixman_box32_t){ 0, 0, width, height });
+    }
+    shm->width = width;
+    shm->height = height;
+    shm->resized = TRUE;
+    return TRUE;
+}
+
+uint32_t *glue_shm_begin_frame(GlueShm *shm, pixman_region32_t **pending)
+{
+    GlueShmSlot *slot = &shm->header->slots[shm->back];
+
+    g_atomic_int_inc((gint *)&slot->seqlock);
+    *pending = &shm->pending[shm->back];
+    return slot_pixels(shm, shm->back);
+}
+
+void glue_shm_publish(GlueShm *shm, pixman_region32_t *damage,
+		      uint32_t sequence, GlueDisplayOrigin origin)
+{
+    GlueShmHeader *header = shm->header;
+    GlueShmSlot *slot = &header->slots[shm->back];
+    GlueShmFrameInfo *info = &header->frames[sequence % GLUE_SHM_RING_SIZE];
+    pixman_box32_t *boxes;
+    int i, n_boxes;
+
+    for (i = 0; i < GLUE_SHM_SLOTS; i++) {
+	if (i != shm->back)
+	    pixman_region32_union(&shm->pending[i], &shm->pending[i], damage);
+    }
+
+    header->origin = origin;
+    slot->sequence = sequence;
+    slot->width = shm->width;
+    slot->height = shm->height;
+    g_atomic_int_inc((gint *)&slot->seqlock);
+
+    g_atomic_int_set((gint *)&info->sequence, 0);
+    info->slot = shm->back;
+    boxes = pixman_region32_rectangles(damage, &n_boxes);
+    if (n_boxes > GLUE_MAX_DIRTY_RECTS) {
+	boxes = pixman_region32_extents(damage);
+	n_boxes = 1;
+    }
+    for (i = 0; i < n_boxes; i++) {
+	info->rects[i].x = boxes[i].x1;
+	info->rects[i].width = boxes[i].x2 - boxes[i].x1;
+	info->rects[i].height = boxes[i].y2 - boxes[i].y1;
+	if (origin == GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT)
+	    info->rects[i].y = shm->height - boxes[i].y2;
+	else
+	    info->rects[i].y = boxes[i].y1;
+    }
+    info->n_rects = shm->resized ? 0 : n_boxes;
+    shm->resized = FALSE;
+    g_atomic_int_set((gint *)&info->sequence, sequence);
+    g_atomic_int_set((gint *)&header->latest, sequence);
+
+    shm->back = (shm->back + 1) % GLUE_SHM_SLOTS;
+}
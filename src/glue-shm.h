@@ -0,0 +1,130 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_SHM_H_
+#define GLUE_SHM_H_
+
+#include <stdint.h>
+#include <pixman.h>
+#include "glib.h"
+#include "mono-glue-types.h"
+#include "glue-service.h"
+
+/*
+ * Layout of the shared memory segment of GLUE_DISPLAY_EXPORT_SHARED_MEMORY
+ * mode. It starts with a GlueShmHeader, followed by GLUE_SHM_SLOTS frame
+ * buffers of slot_size bytes, the first one at header_size bytes. Frames
+ * are ABGR, width * 4 bytes per row, in the row order given by origin.
+ *
+ * The glue writes the slots round-robin, never the one with the latest
+ * frame. A reader maps the segment read-only and, for each frame:
+ *  1. Reads latest (acquire). If it is 0, there is no frame yet.
+ *  2. Reads frames[latest % GLUE_SHM_RING_SIZE]; if its sequence is not
+ *     latest, the ring has been overwritten meanwhile, go back to 1.
+ *  3. Reads the seqlock of the slot of the frame (acquire); if it is odd,
+ *     go back to 1.
+ *  4. Copies n_rects and rects of the frame, then reads its sequence again
+ *     (acquire); if it is not latest, the ring entry was rewritten while it
+ *     was copied, go back to 1.
+ *  5. Uses the pixels of the slot (i.e. uploads them to a texture).
+ *  6. Reads the seqlock again (after an acquire fence); if it has changed,
+ *     the slot was rewritten while it was read, go back to 1.
+ * The rects of a frame are the area that changed since the previous
+ * sequence number; if the reader skipped any frame, or n_rects is 0,
+ * it has to update the whole frame.
+ */
+
+#define GLUE_SHM_MAGIC     0x4D485347 /* "GSHM" */
+#define GLUE_SHM_VERSION   1
+#define GLUE_SHM_SLOTS     3
+#define GLUE_SHM_RING_SIZE 16
+
+typedef struct {
+    /* Incremented before and after writing the slot, odd while it is written */
+    volatile uint32_t seqlock;
+    /* Frame stored in the slot */
+    uint32_t          sequence;
+    uint32_t          width;
+    uint32_t          height;
+} GlueShmSlot;
+
+typedef struct {
+    /* Written last; 0 while the entry is being written */
+    volatile uint32_t sequence;
+    uint32_t          slot;
+    /* 0 if the whole frame changed (i.e. it was resized) */
+    uint32_t          n_rects;
+    MonoGlueRect      rects[GLUE_MAX_DIRTY_RECTS];
+} GlueShmFrameInfo;
+
+typedef struct {
+    uint32_t          magic;
+    uint32_t          version;
+    uint32_t          header_size;
+    uint32_t          slot_size;
+    uint32_t          n_slots;
+    uint32_t          max_width;
+    uint32_t          max_height;
+    /* GlueDisplayOrigin of the frames */
+    uint32_t          origin;
+    /* Sequence number of the latest frame, 0 if there is none */
+    volatile uint32_t latest;
+    uint32_t          reserved;
+    GlueShmSlot       slots[GLUE_SHM_SLOTS];
+    GlueShmFrameInfo  frames[GLUE_SHM_RING_SIZE];
+} GlueShmHeader;
+
+/* Writer side, owned by the GLib main loop and protected by the pipeline lock */
+typedef struct {
+    /* memfd or POSIX shm object, -1 if there is no segment */
+    int               fd;
+    /* Name of the POSIX shm object, empty with a memfd */
+    char              name[64];
+    GlueShmHeader     *header;
+    gsize             size;
+    int32_t           width, height;
+    /* The size has changed since the last frame */
+    gboolean          resized;
+    /* Slot written by the next frame; the latest frame is in the previous one */
+    int               back;
+    /* Damage published since each slot was last written */
+    pixman_region32_t pending[GLUE_SHM_SLOTS];
+} GlueShm;
+
+void glue_shm_init(GlueShm *shm);
+/* Destroys the segment and frees what glue_shm_init() allocated */
+void glue_shm_clear(GlueShm *shm);
+
+/* Creates a segment for frames up to max_width x max_height.
+ * Returns FALSE on error, or if shared memory is not supported. */
+gboolean glue_shm_create(GlueShm *shm, int32_t max_width, int32_t max_height);
+void glue_shm_destroy(GlueShm *shm);
+
+/* Sets the size of the next frames. Returns FALSE if there is no
+ * segment, or it is too small for them. */
+gboolean glue_shm_resize(GlueShm *shm, int32_t width, int32_t height);
+
+/* Marks the back slot as being written and returns its pixels. *pending is
+ * the area of the slot that the frame has to bring up to date. */
+uint32_t *glue_shm_begin_frame(GlueShm *shm, pixman_region32_t **pending);
+
+/* Makes the back slot the latest frame. damage is the area that changed
+ * since the previous frame, in top-left coordinates. */
+void glue_shm_publish(GlueShm *shm, pixman_region32_t *damage,
+		      uint32_t sequence, GlueDisplayOrigin origin);
+
+#endif /* GLUE_SHM_H_ */
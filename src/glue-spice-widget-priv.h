@@ -39,6 +39,10 @@ G_BEGIN_DECLS
 #include <spice-gtk/spice-common.h>
 #include <spice-gtk/spice-util-priv.h>
 
+#include "glue-pixels.h"
+#include "glue-pipeline.h"
+#include "glue-session.h"
+#include "glue-cursor.h"
 #include "mono-glue-types.h"
 
 #define SPICE_DISPLAY_GET_PRIVATE(obj)                                  \
@@ -48,6 +52,12 @@ G_BEGIN_DECLS
 struct _SpiceDisplayPrivate {
     gint                    channel_id;
     gint                    monitor_id;
+    /* session the display belongs to */
+    GlueSession             *glue_session;
+    /* buffers and damage of this monitor, shared with the host */
+    GluePipeline            *pipeline;
+    /* server_generation of glue_session when the display was created */
+    guint                   server_generation;
 
     /* options */
     bool                    keyboard_grab_enable;
@@ -62,7 +72,16 @@ struct _SpiceDisplayPrivate {
     gint                    width, height, stride;
     gint                    shmid;
     gpointer                data_origin; /* the original display image data */
-    gpointer                data; /* converted if necessary to 32 bits */
+    gpointer                data; /* the monitor area of the surface, never converted in place */
+    /* Whole primary surface, and position of the monitor in it. data, width
+     * and height only describe the monitor, the rest is not exported */
+    gint                    surface_width, surface_height;
+    gint                    area_x, area_y;
+    /* converts a row of data to the glue display buffer (32 bits ABGR) */
+    GlueConvertRowFunc      convert_row;
+    gint                    bytes_per_pixel;
+    /* 16 bits surface, convert_row expands its pixels to 32 bits */
+    bool                    expand_16bpp;
 
      /* current display buffer size */
     uint32_t                disp_buffer_width;
@@ -71,7 +90,6 @@ struct _SpiceDisplayPrivate {
     /* (ww, wh): window width/heigth; (mx, my): window position (x,y) */
     gint                    ww, wh, wx, wy;
 
-    bool                    convert;
     bool                    have_mitshm;
     gboolean                allow_scaling;
     gboolean                only_downscale;
@@ -98,12 +116,14 @@ struct _SpiceDisplayPrivate {
     
     /* MUTEX to control cursor access */
     STATIC_MUTEX            cursor_lock;
-    /* Client mode mouse, for mono client */
-    MonoGlueCursor	    *mouse_cursor;
-    /* Internal cursor identification */
-    guint32                 idCursor;
-    /* Hidden cursor, for mono client */
-    MonoGlueCursor          *show_cursor;
+    /* Client mode mouse, for mono client: the guest shape, whether it
+     * is shown, and the id of the shape shown to the host */
+    GlueCursorView          cursor_view;
+    /* Shapes received from the cursor channel */
+    GlueCursorCache         cursor_cache;
+    /* Position, visibility and shape of the cursor, read by the host
+     * without taking cursor_lock */
+    GlueCursorState         cursor_state;
 
     int                     mouse_last_x;
     int                     mouse_last_y;
@@ -111,6 +131,21 @@ struct _SpiceDisplayPrivate {
     int                     mouse_guest_x;
     int                     mouse_guest_y;
 
+    /* Motion not sent yet, see SpiceGlibGlueSetMotionRate(). The lock
+     * protects it against the source that sends it from the main loop, and
+     * is held to send anything else on inputs, and to change it */
+    GMutex                  motion_lock;
+    gboolean                motion_pending;
+    enum SpiceMouseMode     motion_mode;
+    /* Last position in client mode, accumulated motion in server mode */
+    gint                    motion_x, motion_y;
+    int16_t                 motion_button_state;
+    gint64                  motion_last_sent;
+    /* When the oldest pending motion entered the glue, 0 if not traced */
+    gint64                  motion_received;
+    /* One-shot source that sends the pending motion when it is due */
+    GSource                 *motion_source;
+
     bool                    keyboard_grab_active;
     bool                    have_focus;
 
@@ -35,9 +35,21 @@
 #endif
 #endif
 
+#include <pixman.h>
+
 #include "glue-spice-widget.h"
 #include "glue-spice-widget-priv.h"
 #include "glue-service.h"
+#include "glue-pixels.h"
+#include "glue-stripes.h"
+#include "glue-triple-buffer.h"
+#include "glue-stats.h"
+#include "glue-scale.h"
+#include "glue-notify.h"
+#include "glue-shm.h"
+#include "glue-tiles.h"
+#include "glue-cursor.h"
+#include "glue-input-ring.h"
 #include "mono-glue-types.h"
 
 
@@ -65,8 +77,12 @@ static void channel_new(SpiceSession *s, SpiceChannel *channel, gpointer data);
 static void channel_destroy(SpiceSession *s, SpiceChannel *channel, gpointer data);
 static void sync_keyboard_lock_modifiers(SpiceDisplay *display);
 static void try_mouse_ungrab(SpiceDisplay *display);
-
-int16_t SpiceGlibGlueOnGainFocus();
+static void update_keyboard_focus(SpiceDisplay *display, gboolean state);
+static void publish_cursor_state(SpiceDisplayPrivate *d);
+static void invalidate(SpiceChannel *channel,
+                       gint x, gint y, gint w, gint h, gpointer data);
+static void schedule_copy(SpiceDisplayPrivate *d);
+static void update_area(SpiceDisplay *display, gint x, gint y, gint width, gint height);
 
 static gint get_display_id(SpiceDisplay *display)
 {
@@ -112,11 +128,32 @@ static void spice_display_dispose(GObject *obj)
 	g_object_unref(d->session);
 	d->session = NULL;
     }
+    g_mutex_lock(&global_display_lock);
+    if (global_display == display)
+	global_display = NULL;
+    g_mutex_unlock(&global_display_lock);
+
+    g_mutex_lock(&d->motion_lock);
+    if (d->motion_source != NULL) {
+	g_source_destroy(d->motion_source);
+	d->motion_source = NULL;
+    }
+    d->motion_pending = FALSE;
+    d->inputs = NULL;
+    g_mutex_unlock(&d->motion_lock);
+
+    STATIC_MUTEX_LOCK(d->cursor_lock);
+    glue_cursor_view_set_shape(&d->cursor_view, NULL);
+    glue_cursor_cache_clear(&d->cursor_cache);
+    STATIC_MUTEX_UNLOCK(d->cursor_lock);
 }
 
 static void spice_display_finalize(GObject *obj)
 {
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(obj);
+
     SPICE_DEBUG("Finalize spice display");
+    g_mutex_clear(&d->motion_lock);
     G_OBJECT_CLASS(spice_display_parent_class)->finalize(obj);
 }
 
@@ -167,10 +204,13 @@ static void spice_display_class_init(SpiceDisplayClass *klass)
 }
 
 
+extern volatile gint glue_allow_scaling;
+extern volatile gint glue_only_downscale;
+extern volatile gint glue_zoom_level;
+
 static void spice_display_init(SpiceDisplay *display)
 {
     SPICE_DEBUG("%s", __FUNCTION__);
-    global_display = display;
     SpiceDisplayPrivate *d;
 
     d = display->priv = SPICE_DISPLAY_GET_PRIVATE(display);
@@ -178,11 +218,17 @@ static void spice_display_init(SpiceDisplay *display)
     d->have_mitshm = true;
     d->mouse_last_x = -1;
     d->mouse_last_y = -1;
+    d->mouse_guest_x = -1;
+    d->mouse_guest_y = -1;
 
     d->resize_guest_enable=true;
-    SpiceGlibGlueOnGainFocus();
+    update_keyboard_focus(display, true);
 
     STATIC_MUTEX_INIT(d->cursor_lock);
+    g_mutex_init(&d->motion_lock);
+    glue_cursor_view_init(&d->cursor_view);
+    glue_cursor_cache_init(&d->cursor_cache);
+    glue_cursor_state_init(&d->cursor_state);
 }
 
 /* ---------------------------------------------------------------- */
@@ -372,6 +418,7 @@ static void update_mouse_mode(SpiceChannel *channel, gpointer data)
     default:
 	g_warn_if_reached();
     }
+    publish_cursor_state(d);
 
     // next line would update the cursor image if we used gtk (gdk_window_set_cursor)
     // But we update this data by polling (a-la xna)
@@ -419,24 +466,20 @@ static void update_monitor_area(SpiceDisplay *display)
 				  c->x, c->y, c->width, c->height, FALSE);
     }
 
-    //update_area(display, c->x, c->y, c->width, c->height);
+    update_area(display, c->x, c->y, c->width, c->height);
     g_clear_pointer(&monitors, g_array_unref);
     return;
 
  whole:
     g_clear_pointer(&monitors, g_array_unref);
     /* by display whole surface */
-    //update_area(display, 0, 0, d->width, d->height);
+    update_area(display, 0, 0, d->surface_width, d->surface_height);
     //set_monitor_ready(display, true);
 }
 
-int32_t SpiceGlibRecalcGeometry(int32_t x, int32_t y, int32_t w, int32_t h) {
-
-    if (global_display == NULL) {
-	return -1;
-    }
-    SpiceDisplay* display = global_display;
-
+static int32_t recalc_display_geometry(SpiceDisplay *display,
+				       int32_t x, int32_t y, int32_t w, int32_t h)
+{
     SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
     if (d->data == NULL) {
 	return -1;
@@ -444,8 +487,12 @@ int32_t SpiceGlibRecalcGeometry(int32_t x, int32_t y, int32_t w, int32_t h) {
 
     gdouble zoom = 1.0;
 
-    // if (spicex_is_scaled(display)) This says if (backend X/Cairo) supports scaling images
-    //  zoom = (gdouble)d->zoom_level / 100;
+    /* The copy to the glue display buffer scales the display to the window */
+    if (g_atomic_int_get(&glue_allow_scaling)) {
+	zoom = (gdouble)g_atomic_int_get(&glue_zoom_level) / 100;
+	if (g_atomic_int_get(&glue_only_downscale))
+	    zoom = MIN(zoom, 1.0);
+    }
 
     SPICE_DEBUG("recalc1 geom monitor: %d:%d, guest +%d+%d, window %dx%d, zoom %g",
 		d->channel_id, d->monitor_id,
@@ -459,22 +506,36 @@ int32_t SpiceGlibRecalcGeometry(int32_t x, int32_t y, int32_t w, int32_t h) {
     return 0;
 }
 
-/* ---------------------------------------------------------------- */
+/* Drops the reference to display taken by the caller */
+static int32_t recalc_geometry(SpiceDisplay *display,
+			       int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    int32_t result;
+
+    if (display == NULL) {
+	return -1;
+    }
 
-#define CONVERT_0565_TO_0888(s)					\
-    (((((s) << 3) & 0xf8) | (((s) >> 2) & 0x7)) |		\
-     ((((s) << 5) & 0xfc00) | (((s) >> 1) & 0x300)) |		\
-     ((((s) << 8) & 0xf80000) | (((s) << 3) & 0x70000)))
+    result = recalc_display_geometry(display, x, y, w, h);
+    g_object_unref(display);
+    return result;
+}
 
-#define CONVERT_0565_TO_8888(s) (CONVERT_0565_TO_0888(s) | 0xff000000)
+int32_t SpiceGlibRecalcGeometry(int32_t x, int32_t y, int32_t w, int32_t h) {
+    return recalc_geometry(glue_ref_global_display(), x, y, w, h);
+}
 
-#define CONVERT_0555_TO_0888(s)				\
-    (((((s) & 0x001f) << 3) | (((s) & 0x001c) >> 2)) |	\
-     ((((s) & 0x03e0) << 6) | (((s) & 0x0380) << 1)) |	\
-     ((((s) & 0x7c00) << 9) | ((((s) & 0x7000)) << 4)))
+/* Like SpiceGlibRecalcGeometry(), for the window of the given monitor */
+int32_t SpiceGlibRecalcGeometryFor(int32_t channel_id, int32_t monitor_id,
+				   int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    return recalc_geometry(glue_pipeline_ref_display(channel_id, monitor_id),
+			   x, y, w, h);
+}
 
-#define CONVERT_0555_TO_8888(s) (CONVERT_0555_TO_0888(s) | 0xff000000)
+/* ---------------------------------------------------------------- */
 
+/* Called with motion_lock held */
 void send_key(SpiceDisplay *display, int scancode, int down)
 {
     SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
@@ -508,6 +569,7 @@ void send_key(SpiceDisplay *display, int scancode, int down)
  * This avoids the "stuck key" problem when widget lost focus with a key pressed
  * and did not receive the release event.
  * This generates more key events than needed, but that is not a big deal.
+ * Called with motion_lock held.
  */
 static void release_keys(SpiceDisplay *display)
 {
@@ -527,13 +589,6 @@ static void release_keys(SpiceDisplay *display)
 
 /* ---------------------------------------------------------------- */
 
-volatile gboolean invalidated = FALSE;
-volatile gint invalidate_x;
-volatile gint invalidate_y;
-volatile gint invalidate_w;
-volatile gint invalidate_h;
-
-
 static void mouse_wrap(SpiceDisplay *display, GlueMotionEvent *motion)
 {
     SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
@@ -627,13 +682,124 @@ void spicex_transform_input (SpiceDisplay *display,
     *input_y = floor (window_y);
 }
 
-int16_t SpiceGlibGlueButtonEvent(int32_t eventX, int32_t eventY,
-				 int16_t buttonId, int16_t buttonState, int16_t isDown)
+extern volatile gint glue_motion_interval;
+extern volatile gint glue_input_tracing;
+
+/* Sends the motion coalesced so far. Called with motion_lock held */
+static void send_pending_motion(SpiceDisplay *display, gint64 now)
 {
-    if (global_display == NULL) {
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
+
+    if (!d->motion_pending)
+	return;
+
+    d->motion_pending = FALSE;
+    d->motion_last_sent = now;
+    if (d->inputs == NULL)
+	return;
+
+    if (d->motion_received != 0)
+	glue_stats_input_sent(d->motion_received, now);
+
+    if (d->motion_mode == SPICE_MOUSE_MODE_CLIENT)
+	spice_inputs_position(d->inputs, d->motion_x, d->motion_y, get_display_id(display),
+			      button_mask_monoglue_to_spice(d->motion_button_state));
+    else
+	spice_inputs_motion(d->inputs, d->motion_x, d->motion_y,
+			    button_mask_monoglue_to_spice(d->motion_button_state));
+    glue_stats_motion_sent();
+}
+
+/* Takes motion_lock to send other messages on the inputs channel, after
+ * the pending motion. The main loop sends the delayed motion while host
+ * threads send the rest, so every message is sent with the lock held */
+static void lock_inputs(SpiceDisplay *display)
+{
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
+
+    g_mutex_lock(&d->motion_lock);
+    send_pending_motion(display, g_get_monotonic_time());
+}
+
+static void unlock_inputs(SpiceDisplay *display)
+{
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
+
+    g_mutex_unlock(&d->motion_lock);
+}
+
+static gboolean motion_source_dispatch(GSource *source, GSourceFunc callback,
+				       gpointer user_data)
+{
+    return callback(user_data);
+}
+
+static GSourceFuncs motion_source_funcs = {
+    NULL, NULL, motion_source_dispatch, NULL
+};
+
+static gboolean send_motion_when_due(gpointer data)
+{
+    SpiceDisplay *display = data;
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
+
+    g_mutex_lock(&d->motion_lock);
+    d->motion_source = NULL;
+    send_pending_motion(display, g_get_monotonic_time());
+    g_mutex_unlock(&d->motion_lock);
+    return G_SOURCE_REMOVE;
+}
+
+/* Sends a motion event, or merges it with the pending one if the last
+ * message was sent less than glue_motion_interval ago. (x, y) is the
+ * position in client mode and the relative motion in server mode. */
+static void queue_motion(SpiceDisplay *display, enum SpiceMouseMode mode,
+			 gint x, gint y, int16_t buttonState, gint64 received)
+{
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
+    gint64 interval = g_atomic_int_get(&glue_motion_interval);
+    gint64 now = g_get_monotonic_time();
+    gboolean changed;
+
+    glue_stats_motion_received();
+
+    g_mutex_lock(&d->motion_lock);
+    changed = d->motion_pending &&
+	(d->motion_mode != mode || d->motion_button_state != buttonState);
+    if (changed)
+	send_pending_motion(display, now);
+
+    if (d->motion_pending && mode == SPICE_MOUSE_MODE_SERVER) {
+	d->motion_x += x;
+	d->motion_y += y;
+    } else {
+	d->motion_x = x;
+	d->motion_y = y;
+    }
+    if (!d->motion_pending)
+	d->motion_received = received;
+    d->motion_pending = TRUE;
+    d->motion_mode = mode;
+    d->motion_button_state = buttonState;
+
+    if (changed || interval <= 0 || now >= d->motion_last_sent + interval) {
+	send_pending_motion(display, now);
+    } else if (d->motion_source == NULL) {
+	d->motion_source = g_source_new(&motion_source_funcs, sizeof(GSource));
+	g_source_set_callback(d->motion_source, send_motion_when_due, display, NULL);
+	g_source_set_ready_time(d->motion_source, d->motion_last_sent + interval);
+	g_source_attach(d->motion_source, NULL);
+	g_source_unref(d->motion_source);
+    }
+    g_mutex_unlock(&d->motion_lock);
+}
+
+static int16_t button_event(SpiceDisplay *display, int32_t eventX, int32_t eventY,
+			    int16_t buttonId, int16_t buttonState, int16_t isDown)
+{
+    if (display == NULL) {
 	return -1;
     }
-    SpiceDisplay* display = global_display;
 
     SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
     if (d->data == NULL) {
@@ -677,7 +843,10 @@ int16_t SpiceGlibGlueButtonEvent(int32_t eventX, int32_t eventY,
     if (!d->inputs)
 	return true;
 
-    if (isDown) {
+    lock_inputs(display);
+    if (d->inputs == NULL) {
+	/* Gone meanwhile */
+    } else if (isDown) {
 	spice_inputs_button_press(d->inputs,
 				  button_mono_to_spice(buttonId),
 				  button_mask_monoglue_to_spice(buttonState));
@@ -686,23 +855,23 @@ int16_t SpiceGlibGlueButtonEvent(int32_t eventX, int32_t eventY,
 				    button_mono_to_spice(buttonId),
 				    button_mask_monoglue_to_spice(buttonState));
     }
+    unlock_inputs(display);
     return true;
 }
 
-int16_t SpiceGlibGlueMotionEvent(int32_t eventX, int32_t eventY,
-				 int16_t buttonState)
+/* received is when the event entered the glue, 0 if it is not traced */
+static int16_t motion_event(SpiceDisplay *display, int32_t eventX, int32_t eventY,
+			    int16_t buttonState, gint64 received)
 {
     //SPICE_DEBUG("%s: pointer  x: %d, y: %d, state: %d", __FUNCTION__, eventX, eventY, buttonState);
-    SpiceDisplay *display;
     SpiceDisplayPrivate *d;
     GlueMotionEvent event;
     int x, y;
 
-    if (global_display == NULL) {
+    if (display == NULL) {
 	return -1;
     }
 
-    display = global_display;
     d = SPICE_DISPLAY_GET_PRIVATE(display);
     if (d->data == NULL) {
 	return -1;
@@ -725,8 +894,9 @@ int16_t SpiceGlibGlueMotionEvent(int32_t eventX, int32_t eventY,
     case SPICE_MOUSE_MODE_CLIENT:
 	if (x >= 0 && /*x < d->area.width &&*/
 	    y >= 0 /*&& y < d->area.height*/) {
-	    spice_inputs_position(d->inputs, x, y, get_display_id(display),
-				  button_mask_monoglue_to_spice(buttonState));
+	    if (received != 0)
+		glue_trace_input(&d->pipeline->input_trace, received, TRUE, x, y);
+	    queue_motion(display, SPICE_MOUSE_MODE_CLIENT, x, y, buttonState, received);
 	}
 	break;
     case SPICE_MOUSE_MODE_SERVER:
@@ -739,8 +909,11 @@ int16_t SpiceGlibGlueMotionEvent(int32_t eventX, int32_t eventY,
 	    //SPICE_DEBUG("%s: pointer Pasando motion: dx %d, dy %d ", __FUNCTION__, dx, dy);
 
 
-	    spice_inputs_motion(d->inputs, dx, dy,
-				button_mask_monoglue_to_spice(buttonState));
+	    if (received != 0)
+		glue_trace_input(&d->pipeline->input_trace, received, TRUE,
+				 d->mouse_guest_x - d->area_x + dx,
+				 d->mouse_guest_y - d->area_y + dy);
+	    queue_motion(display, SPICE_MOUSE_MODE_SERVER, dx, dy, buttonState, received);
 
 	    d->mouse_last_x = x;
 	    d->mouse_last_y = y;
@@ -778,19 +951,9 @@ static void update_keyboard_focus(SpiceDisplay *display, gboolean state)
     //spice_gtk_session_request_auto_usbredir(d->gtk_session, state);
 }
 
-int16_t SpiceGlibGlueOnGainFocus()
+static int16_t gain_focus(SpiceDisplay *display)
 {
-    SpiceDisplay *display;
-    SpiceDisplayPrivate *d;
-
-    SPICE_DEBUG("%s", __FUNCTION__);
-    if (global_display == NULL) {
-	SPICE_DEBUG("%s ERROR pointer global_display == NULL", __FUNCTION__);
-	return -1;
-    }
-
-    display = global_display;
-    d = SPICE_DISPLAY_GET_PRIVATE(display);
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
 
     if (d == NULL) {
 	SPICE_DEBUG("%s ERROR pointer d->data == NULL", __FUNCTION__);
@@ -817,7 +980,9 @@ int16_t SpiceGlibGlueOnGainFocus()
     }
 
     // We released the keys when we lost focus, so this should do nothing now.
+    lock_inputs(display);
     release_keys(display);
+    unlock_inputs(display);
     sync_keyboard_lock_modifiers(display);
     update_keyboard_focus(display, true);
     // TODO call this again...
@@ -829,18 +994,9 @@ int16_t SpiceGlibGlueOnGainFocus()
     return -1;
 }
 
-int16_t SpiceGlibGlueOnLoseFocus()
+static int16_t lose_focus(SpiceDisplay *display)
 {
-    SpiceDisplay *display;
-    SpiceDisplayPrivate *d;
-
-    SPICE_DEBUG("%s", __FUNCTION__);
-    if (global_display == NULL) {
-	return -1;
-    }
-
-    display = global_display;
-    d = SPICE_DISPLAY_GET_PRIVATE(display);
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
 
     if (d->data == NULL) {
 	return -1;
@@ -854,7 +1010,9 @@ int16_t SpiceGlibGlueOnLoseFocus()
 	return true;
 
 
+    lock_inputs(display);
     release_keys(display);
+    unlock_inputs(display);
     update_keyboard_focus(display, false);
 
 #ifdef WIN32
@@ -868,16 +1026,16 @@ int16_t SpiceGlibGlueOnLoseFocus()
 }
 
 
-int16_t SpiceGlibGlueScrollEvent(int16_t buttonState, int16_t isDown)
+static int16_t scroll_event(SpiceDisplay *display, int16_t buttonState, int16_t isDown)
 {
-    SpiceDisplay *display;
     SpiceDisplayPrivate *d;
     int button;
 
-    if (global_display == NULL) {
+    if (display == NULL) {
 	return -1;
     }
 
+    d = SPICE_DISPLAY_GET_PRIVATE(display);
     if (d->data == NULL) {
 	return -1;
     }
@@ -894,28 +1052,442 @@ int16_t SpiceGlibGlueScrollEvent(int16_t buttonState, int16_t isDown)
     else
 	button = SPICE_MOUSE_BUTTON_DOWN;
 
-    spice_inputs_button_press(d->inputs, button,
-			      button_mask_monoglue_to_spice(buttonState));
-    spice_inputs_button_release(d->inputs, button,
-				button_mask_monoglue_to_spice(buttonState));
+    lock_inputs(display);
+    if (d->inputs != NULL) {
+	spice_inputs_button_press(d->inputs, button,
+				  button_mask_monoglue_to_spice(buttonState));
+	spice_inputs_button_release(d->inputs, button,
+				    button_mask_monoglue_to_spice(buttonState));
+    }
+    unlock_inputs(display);
     return true;
 }
 
+static int32_t key_event(SpiceDisplay *display, int16_t isDown, int32_t hardware_keycode,
+			 gint64 received)
+{
+    SpiceDisplayPrivate *d;
+    int scancode;
+
+    if (display == NULL) {
+        return -1;
+    }
+
+    d = SPICE_DISPLAY_GET_PRIVATE(display);
+    if (d->data == NULL) {
+        return -1;
+    }
+
+    SPICE_DEBUG("isDown= %d, hardware_keycode=%d", isDown, hardware_keycode);
+
+    if (!d->inputs)
+    	return-1;
+
+    scancode = hardware_keycode;
+    lock_inputs(display);
+    if (received != 0)
+	glue_trace_input(&d->pipeline->input_trace, received, FALSE, 0, 0);
+    if (isDown) {
+        send_key(display, scancode, 1);
+    } else {
+	send_key(display, scancode, 0);
+    }
+    unlock_inputs(display);
+    if (received != 0)
+	glue_stats_input_sent(received, g_get_monotonic_time());
+    return 0;
+}
+
+static int16_t input_event(SpiceDisplay *display, const GlueInputEvent *event,
+			   gint64 received)
+{
+    switch (event->type) {
+    case GLUE_INPUT_EVENT_MOTION:
+	return motion_event(display, event->x, event->y, event->buttonState, received);
+    case GLUE_INPUT_EVENT_BUTTON:
+	return button_event(display, event->x, event->y,
+			    event->buttonId, event->buttonState, event->isDown);
+    case GLUE_INPUT_EVENT_KEY:
+	return key_event(display, event->isDown, event->keycode, received);
+    case GLUE_INPUT_EVENT_SCROLL:
+	return scroll_event(display, event->buttonState, event->isDown);
+    default:
+	SPICE_DEBUG("%s: unknown input event type %d", __FUNCTION__, event->type);
+	return -1;
+    }
+}
+
+/* Events are queued to the main loop, see SpiceGlibGlueSetQueuedInput() */
+static volatile gint queued_input = FALSE;
+
+/* New reference to the display, channel_id -1 is the default one */
+static SpiceDisplay *ref_input_display(gint channel_id, gint monitor_id)
+{
+    return channel_id < 0 ? glue_ref_global_display() :
+	glue_pipeline_ref_display(channel_id, monitor_id);
+}
+
+static gint64 input_timestamp(void)
+{
+    return g_atomic_int_get(&glue_input_tracing) ? g_get_monotonic_time() : 0;
+}
+
+static void run_queued_input(const GlueQueuedInput *input, gpointer user_data)
+{
+    SpiceDisplay *display = ref_input_display(input->channel_id, input->monitor_id);
+
+    if (display == NULL)
+	return;
+
+    if (input->event.type == GLUE_INPUT_EVENT_FOCUS) {
+	if (input->event.isDown)
+	    gain_focus(display);
+	else
+	    lose_focus(display);
+    } else {
+	input_event(display, &input->event, input->received);
+    }
+    g_object_unref(display);
+}
+
+/* Returns FALSE if the queue is full and the event is dropped */
+static gboolean queue_input(gint channel_id, gint monitor_id, const GlueInputEvent *event)
+{
+    GlueQueuedInput input;
+
+    input.event = *event;
+    input.channel_id = channel_id;
+    input.monitor_id = monitor_id;
+    input.received = input_timestamp();
+    if (glue_input_ring_push(&input))
+	return TRUE;
+
+    glue_stats_input_dropped();
+    return FALSE;
+}
+
+/* Runs the event, or queues it. Queued events return 0, or -1 if they are dropped */
+static int16_t submit_input(gint channel_id, gint monitor_id, const GlueInputEvent *event)
+{
+    SpiceDisplay *display;
+    int16_t result;
+
+    if (g_atomic_int_get(&queued_input))
+	return queue_input(channel_id, monitor_id, event) ? 0 : -1;
+
+    display = ref_input_display(channel_id, monitor_id);
+    result = input_event(display, event, input_timestamp());
+    if (display != NULL)
+	g_object_unref(display);
+    return result;
+}
+
+/**
+ * Runs the input events in the GLib main loop instead of the thread that
+ * sends them. They are copied to a lock-free queue, and the event functions
+ * return 0 right away, or -1 if the queue is full and the event is lost
+ * (see GlueInputStats.input_dropped). Focus changes are queued with them.
+ * Events must then be sent from a single thread, the one that changes
+ * this setting.
+ * Params: enabled
+ *  Disabled by default, the events run in the calling thread. When it is
+ *  disabled, it waits for the queued events to run, so that the next ones
+ *  do not overtake them; the host must not hold a display buffer locked.
+ **/
+void SpiceGlibGlueSetQueuedInput(int16_t enabled)
+{
+    SPICE_DEBUG("SpiceGlibGlueSetQueuedInput %d", enabled);
+
+    if (enabled)
+	glue_input_ring_init(run_queued_input, NULL);
+    g_atomic_int_set(&queued_input, enabled != 0);
+    if (!enabled)
+	glue_input_ring_flush();
+}
+
+/* Returns 0 when it is queued, -1 if it is dropped */
+static int16_t queue_focus(gboolean gained)
+{
+    GlueInputEvent event = { GLUE_INPUT_EVENT_FOCUS, 0, 0, 0,
+			     0, 0, gained, 0 };
+
+    return queue_input(-1, -1, &event) ? 0 : -1;
+}
+
+int16_t SpiceGlibGlueOnGainFocus()
+{
+    SpiceDisplay *display;
+    int16_t result;
+
+    SPICE_DEBUG("%s", __FUNCTION__);
+    if (g_atomic_int_get(&queued_input))
+	return queue_focus(TRUE);
+
+    display = glue_ref_global_display();
+    if (display == NULL) {
+	SPICE_DEBUG("%s ERROR pointer global_display == NULL", __FUNCTION__);
+	return -1;
+    }
+
+    result = gain_focus(display);
+    g_object_unref(display);
+    return result;
+}
+
+int16_t SpiceGlibGlueOnLoseFocus()
+{
+    SpiceDisplay *display;
+    int16_t result;
+
+    SPICE_DEBUG("%s", __FUNCTION__);
+    if (g_atomic_int_get(&queued_input))
+	return queue_focus(FALSE);
+
+    display = glue_ref_global_display();
+    if (display == NULL) {
+	return -1;
+    }
+
+    result = lose_focus(display);
+    g_object_unref(display);
+    return result;
+}
+
+int16_t SpiceGlibGlueButtonEvent(int32_t eventX, int32_t eventY,
+				 int16_t buttonId, int16_t buttonState, int16_t isDown)
+{
+    GlueInputEvent event = { GLUE_INPUT_EVENT_BUTTON, eventX, eventY, 0,
+			     buttonId, buttonState, isDown, 0 };
+
+    return submit_input(-1, -1, &event);
+}
+
+/* Like SpiceGlibGlueButtonEvent(), with coordinates of the given monitor */
+int16_t SpiceGlibGlueButtonEventFor(int32_t channel_id, int32_t monitor_id,
+				    int32_t eventX, int32_t eventY,
+				    int16_t buttonId, int16_t buttonState, int16_t isDown)
+{
+    GlueInputEvent event = { GLUE_INPUT_EVENT_BUTTON, eventX, eventY, 0,
+			     buttonId, buttonState, isDown, 0 };
+
+    return submit_input(channel_id, monitor_id, &event);
+}
+
+int16_t SpiceGlibGlueMotionEvent(int32_t eventX, int32_t eventY,
+				 int16_t buttonState)
+{
+    GlueInputEvent event = { GLUE_INPUT_EVENT_MOTION, eventX, eventY, 0,
+			     0, buttonState, 0, 0 };
+
+    return submit_input(-1, -1, &event);
+}
+
+/* Like SpiceGlibGlueMotionEvent(), with coordinates of the given monitor.
+ * In client mouse mode the guest places the pointer on that monitor. */
+int16_t SpiceGlibGlueMotionEventFor(int32_t channel_id, int32_t monitor_id,
+				    int32_t eventX, int32_t eventY, int16_t buttonState)
+{
+    GlueInputEvent event = { GLUE_INPUT_EVENT_MOTION, eventX, eventY, 0,
+			     0, buttonState, 0, 0 };
+
+    return submit_input(channel_id, monitor_id, &event);
+}
+
+int16_t SpiceGlibGlueScrollEvent(int16_t buttonState, int16_t isDown)
+{
+    GlueInputEvent event = { GLUE_INPUT_EVENT_SCROLL, 0, 0, 0,
+			     0, buttonState, isDown, 0 };
+
+    return submit_input(-1, -1, &event);
+}
+
+int32_t SpiceGlibGlue_SpiceKeyEvent(int16_t isDown, int32_t hardware_keycode)
+{
+    GlueInputEvent event = { GLUE_INPUT_EVENT_KEY, 0, 0, hardware_keycode,
+			     0, 0, isDown, 0 };
+
+    return submit_input(-1, -1, &event);
+}
+
+/* Drops the reference to display taken by the caller */
+static int32_t send_input_events(SpiceDisplay *display,
+				 GlueInputEvent *events, int32_t count)
+{
+    int32_t i, errors = 0;
+
+    for (i = 0; i < count; i++) {
+	events[i].result = display != NULL ?
+	    input_event(display, &events[i], input_timestamp()) : -1;
+	if (events[i].result < 0)
+	    errors++;
+    }
+    if (display == NULL)
+	return -1;
+
+    g_object_unref(display);
+    return errors;
+}
+
+static int32_t input_events(gint channel_id, gint monitor_id,
+			    GlueInputEvent *events, int32_t count)
+{
+    SpiceDisplay *display;
+    int32_t i, errors = 0;
+
+    if (events == NULL || count < 0)
+	return -1;
+
+    if (g_atomic_int_get(&queued_input)) {
+	for (i = 0; i < count; i++) {
+	    /* Like an unknown type when it is not queued */
+	    events[i].result = events[i].type != GLUE_INPUT_EVENT_FOCUS &&
+		queue_input(channel_id, monitor_id, &events[i]) ? 0 : -1;
+	    if (events[i].result < 0)
+		errors++;
+	}
+	return errors;
+    }
+
+    display = ref_input_display(channel_id, monitor_id);
+    return send_input_events(display, events, count);
+}
+
+/**
+ * Sends several input events in a single call, in the order they are in the
+ * array, as if each one was sent with its own call (SpiceGlibGlueMotionEvent(),
+ * SpiceGlibGlueButtonEvent(), SpiceGlibGlue_SpiceKeyEvent() or
+ * SpiceGlibGlueScrollEvent()). An event that fails does not stop the rest.
+ * Params:
+ *  events: array of events; OUT: the result field of each one is set.
+ *  count: number of events in the array.
+ * Returns: -1 if there is no display (and then every result is -1),
+ *  otherwise the number of events that failed. With queued input, the
+ *  number of events that did not fit in the queue.
+ **/
+int32_t SpiceGlibGlueInputEvents(GlueInputEvent *events, int32_t count)
+{
+    return input_events(-1, -1, events, count);
+}
+
+/* Like SpiceGlibGlueInputEvents(), with coordinates of the given monitor */
+int32_t SpiceGlibGlueInputEventsFor(int32_t channel_id, int32_t monitor_id,
+				    GlueInputEvent *events, int32_t count)
+{
+    return input_events(channel_id, monitor_id, events, count);
+}
+
+/* Like SpiceGlibGlueInputEventsFor(), for a monitor of the given session.
+ * The events are never queued, they are sent before returning. */
+int32_t SpiceGlibGlueSessionInputEvents(GlueSession *session,
+					int32_t channel_id, int32_t monitor_id,
+					GlueInputEvent *events, int32_t count)
+{
+    if (events == NULL || count < 0)
+	return -1;
+
+    return send_input_events(glue_session_ref_display(session, channel_id, monitor_id),
+			     events, count);
+}
+
+extern volatile gint glue_export_mode;
+extern volatile gint glue_display_origin;
+typedef unsigned int Color32;
+
+/* Called with the pipeline lock held, when the display channel goes away,
+ * before the surface is released. Surfaces destroyed while connected, i.e.
+ * on a resolution change, are not worth keeping */
+static void keep_last_surface(SpiceDisplayPrivate *d)
+{
+    GluePipeline *p = d->pipeline;
+
+    /* The monitors of a channel share its surface, monitor 0 keeps it whole */
+    if (d->data_origin == NULL || d->surface_height <= 0 || d->stride <= 0 ||
+	d->monitor_id != 0)
+	return;
+
+    g_free(p->last_surface);
+    p->last_surface = g_memdup(d->data_origin, d->stride * d->surface_height);
+    p->last_format = d->format;
+    p->last_width = d->surface_width;
+    p->last_height = d->surface_height;
+    p->last_stride = d->stride;
+    p->last_generation = d->server_generation;
+}
+
+/* Called with the pipeline lock held. The kept surface is used once, even
+ * if it does not fit the new one; only monitor 0 has one, the other
+ * monitors copy their part when update_area() finds it.
+ * Returns TRUE if the new surface has got the pixels of the last one. */
+static gboolean restore_last_surface(SpiceDisplayPrivate *d)
+{
+    GluePipeline *p = d->pipeline;
+    gboolean restored = FALSE;
+
+    if (p->last_surface == NULL)
+	return FALSE;
+
+    if (d->data_origin != NULL && p->last_generation == d->server_generation &&
+	p->last_format == d->format &&
+	p->last_width == d->surface_width && p->last_height == d->surface_height &&
+	p->last_stride == d->stride) {
+	SPICE_DEBUG("restoring the last primary surface of %d:%d",
+		    d->channel_id, d->monitor_id);
+	memcpy(d->data_origin, p->last_surface, d->stride * d->surface_height);
+	restored = TRUE;
+    }
+    g_free(p->last_surface);
+    p->last_surface = NULL;
+    return restored;
+}
+
 static void primary_create(SpiceChannel *channel,
 			   gint format, gint width, gint height, gint stride,
 			   gint shmid, gpointer imgdata, gpointer data)
 {
     SpiceDisplay *display = data;
     SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
+    gboolean restored;
 
+    /* The host may be reading the surface in GLUE_DISPLAY_EXPORT_SURFACE mode */
+    g_mutex_lock(&d->pipeline->lock);
     d->format = format;
     d->stride = stride;
     d->shmid = shmid;
-    d->width = width;
-    d->height = height;
+    /* The whole surface until update_monitor_area() finds the monitor */
+    d->surface_width = d->width = width;
+    d->surface_height = d->height = height;
+    d->area_x = d->area_y = 0;
     d->data_origin = d->data = imgdata;
+    restored = restore_last_surface(d);
+
+    /* 16 bits surfaces are expanded to 32 bits while copying them */
+    switch (format) {
+    case SPICE_SURFACE_FMT_16_565:
+	d->expand_16bpp = true;
+	d->convert_row = glue_rgb565_to_abgr_row;
+	d->bytes_per_pixel = 2;
+	break;
+    case SPICE_SURFACE_FMT_16_555:
+	d->expand_16bpp = true;
+	d->convert_row = glue_rgb555_to_abgr_row;
+	d->bytes_per_pixel = 2;
+	break;
+    default:
+	d->expand_16bpp = false;
+	d->convert_row = glue_argb_to_abgr_row;
+	d->bytes_per_pixel = 4;
+	break;
+    }
+    g_mutex_unlock(&d->pipeline->lock);
 
+    glue_timeline_step(&d->glue_session->timeline, GLUE_CONNECT_PRIMARY_CREATE);
     update_monitor_area(display);
+    /* Show it right away, the server repaints it later */
+    if (restored)
+	invalidate(channel, 0, 0, width, height, display);
+    else if (d->pipeline->invalidated)
+	/* The copy may have been waiting for a surface */
+	schedule_copy(d);
 }
 
 static void primary_destroy(SpiceChannel *channel, gpointer data)
@@ -924,6 +1496,7 @@ static void primary_destroy(SpiceChannel *channel, gpointer data)
     SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
 
     //spicex_image_destroy(display);
+    g_mutex_lock(&d->pipeline->lock);
     d->format = 0;
     d->width  = 0;
     d->height = 0;
@@ -931,99 +1504,544 @@ static void primary_destroy(SpiceChannel *channel, gpointer data)
     d->shmid  = 0;
     d->data   = NULL;
     d->data_origin = NULL;
+    d->surface_width = d->surface_height = 0;
+    d->area_x = d->area_y = 0;
+    g_mutex_unlock(&d->pipeline->lock);
 }
 
-extern uint32_t *glue_display_buffer;
-extern gboolean updatedDisplayBuffer;
+/* Makes the display export the area of the primary surface that belongs
+ * to its monitor, clipped to the surface. The pipeline sees that area as
+ * if it were the whole surface; the damage is translated by invalidate() */
+static void update_area(SpiceDisplay *display, gint x, gint y, gint width, gint height)
+{
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
+    gint x1, y1, x2, y2;
+
+    g_mutex_lock(&d->pipeline->lock);
+    x1 = CLAMP(x, 0, d->surface_width);
+    y1 = CLAMP(y, 0, d->surface_height);
+    x2 = CLAMP(x + width, x1, d->surface_width);
+    y2 = CLAMP(y + height, y1, d->surface_height);
+    if (d->data_origin == NULL || x2 == x1 || y2 == y1 ||
+	(x1 == d->area_x && y1 == d->area_y &&
+	 x2 - x1 == d->width && y2 - y1 == d->height)) {
+	g_mutex_unlock(&d->pipeline->lock);
+	return;
+    }
 
-extern STATIC_MUTEX glue_display_lock;
-extern int32_t glue_width;
-extern int32_t glue_height;
-extern int32_t local_width;
-extern int32_t local_height;
-typedef unsigned int Color32;
+    SPICE_DEBUG("monitor %d:%d area +%d+%d %dx%d", d->channel_id, d->monitor_id,
+		x1, y1, x2 - x1, y2 - y1);
+    d->area_x = x1;
+    d->area_y = y1;
+    d->width = x2 - x1;
+    d->height = y2 - y1;
+    d->data = (guint8 *)d->data_origin + (gsize)y1 * d->stride + x1 * d->bytes_per_pixel;
+    g_mutex_unlock(&d->pipeline->lock);
+
+    /* Another part of the surface, copy it whole */
+    invalidate(d->display, x1, y1, x2 - x1, y2 - y1, display);
+}
+
+/* Minimum time between two copies, in microseconds (see SpiceGlibGlueSetFrameRate) */
+extern volatile gint glue_frame_interval;
 
-static inline Color32 ARGBtoABGR(Color32 x)
+/* Copies (and converts) one rectangle of d->data to dst, which has d->width
+ * pixels per row, in origin row order */
+static void copy_rect_to_glue(SpiceDisplayPrivate *d, uint32_t *dst,
+			      const pixman_box32_t *box, GlueDisplayOrigin origin)
 {
-    return (( 0xFF000000) ) | 
-	((x & 0x00FF0000) >> 16) | 
-	((x & 0x0000FF00) ) | 
-	((x & 0x000000FF) <<  16 );
+    guint8 *src2_data = (guint8 *)d->data + d->stride * box->y1 +
+	d->bytes_per_pixel * box->x1;
+    Color32 *dst2_data = (Color32 *)dst;
+    gint dst_step = d->width;
+    int i;
+
+    if (origin == GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT) {
+	dst2_data += (d->height - box->y1 - 1) * d->width;
+	dst_step = -d->width;
+    } else {
+	dst2_data += d->width * box->y1;
+	if (box->x1 == 0 && box->x2 == d->width &&
+	    d->stride == d->width * d->bytes_per_pixel) {
+	    /* Whole rows, contiguous in both buffers: convert them in one go */
+	    d->convert_row(dst2_data, src2_data, (box->y2 - box->y1) * d->width);
+	    return;
+	}
+    }
+
+    for (i = box->y1; i < box->y2; i++) {
+	d->convert_row(dst2_data + box->x1, src2_data, box->x2 - box->x1);
+	dst2_data += dst_step;
+	src2_data += d->stride;
+    }
 }
 
-gint64 last_copy_timestamp = 0;
-volatile int copy_scheduled = 0;
+typedef struct {
+    SpiceDisplayPrivate *d;
+    uint32_t            *dst;
+    GlueDisplayOrigin   origin;
+    pixman_box32_t      *rects;
+    int                 n_rects;
+} CopyJob;
 
-gboolean copy_display_to_glue(SpiceDisplayPrivate *d)
+static gint64 count_pixels(const pixman_box32_t *rects, int n_rects)
 {
-    gint64 now_timestamp = g_get_monotonic_time();
-    gint64 delta = (now_timestamp - last_copy_timestamp);
+    gint64 n_pixels = 0;
+    int i;
+
+    for (i = 0; i < n_rects; i++) {
+	n_pixels += (gint64)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+    }
+    return n_pixels;
+}
 
-    /* Limit copy_display_to_glue to 1000/30 == 33hz */
-    if (delta < 30000) {
-	// SPICE_DEBUG("omitting early copy");
+/* Copies the part of the rectangles of the job within rows [y1, y2) */
+static void copy_stripe_to_glue(gpointer data, int y1, int y2)
+{
+    CopyJob *job = data;
+    int i;
+
+    for (i = 0; i < job->n_rects; i++) {
+	pixman_box32_t box = job->rects[i];
+	box.y1 = MAX(box.y1, y1);
+	box.y2 = MIN(box.y2, y2);
+	if (box.y1 < box.y2)
+	    copy_rect_to_glue(job->d, job->dst, &box, job->origin);
+    }
+}
+
+/* Copies a region of d->data to dst, splitting it in stripes converted
+ * in parallel when it is big enough.
+ * Returns the number of pixels copied. */
+static gint64 copy_region_to_glue(SpiceDisplayPrivate *d, uint32_t *dst,
+				  pixman_region32_t *region, GlueDisplayOrigin origin)
+{
+    pixman_box32_t *extents = pixman_region32_extents(region);
+    gint64 n_pixels;
+    CopyJob job;
+
+    job.d = d;
+    job.dst = dst;
+    job.origin = origin;
+    job.rects = pixman_region32_rectangles(region, &job.n_rects);
+    n_pixels = count_pixels(job.rects, job.n_rects);
+    if (n_pixels == 0)
+	return 0;
+
+    glue_stripes_run(copy_stripe_to_glue, &job, extents->y1, extents->y2, n_pixels);
+    return n_pixels;
+}
+
+/* Size of the frame to copy to the host buffer: the surface, downscaled
+ * by zoom_level and to fit in the host buffer when scaling is allowed */
+static void get_frame_size(SpiceDisplayPrivate *d, GlueDisplayExportMode mode,
+			   int32_t *width, int32_t *height)
+{
+    GluePipeline *p = d->pipeline;
+    gint64 w = d->width, h = d->height;
+    gint zoom_level = g_atomic_int_get(&glue_zoom_level);
+
+    if (g_atomic_int_get(&glue_allow_scaling) && mode == GLUE_DISPLAY_EXPORT_COPY &&
+	w > 0 && h > 0) {
+	if (zoom_level < 100) {
+	    w = w * zoom_level / 100;
+	    h = h * zoom_level / 100;
+	}
+	/* Keep the aspect ratio */
+	if (p->buffer_width > 0 && p->buffer_height > 0 &&
+	    (w > p->buffer_width || h > p->buffer_height)) {
+	    if (w * p->buffer_height > h * p->buffer_width) {
+		h = h * p->buffer_width / w;
+		w = p->buffer_width;
+	    } else {
+		w = w * p->buffer_height / h;
+		h = p->buffer_height;
+	    }
+	}
+	w = MAX(w, 1);
+	h = MAX(h, 1);
+    }
+    *width = w;
+    *height = h;
+}
+
+typedef struct {
+    SpiceDisplayPrivate *d;
+    /* Row 0 of the frame, and pixels to the next row (negative if bottom-up) */
+    uint32_t            *dst;
+    int                 dst_step;
+    pixman_box32_t      *rects;
+    int                 n_rects;
+} ScaleJob;
+
+/* Scales the part of the destination rectangles of the job within rows [y1, y2) */
+static void scale_stripe_to_glue(gpointer data, int y1, int y2)
+{
+    ScaleJob *job = data;
+    SpiceDisplayPrivate *d = job->d;
+    int i;
+
+    for (i = 0; i < job->n_rects; i++) {
+	pixman_box32_t box = job->rects[i];
+	box.y1 = MAX(box.y1, y1);
+	box.y2 = MIN(box.y2, y2);
+	glue_scaler_scale_box(&d->pipeline->scaler, d->convert_row, d->data, d->stride,
+			      d->bytes_per_pixel, job->dst, job->dst_step, &box);
+    }
+}
+
+/* Converts and downscales the damaged area of d->data into a width x height
+ * frame in dst, in one pass. The pending damage is translated to the frame
+ * coordinates, so that the scaled damage is published.
+ * Returns the number of pixels written. */
+static gint64 scale_region_to_glue(SpiceDisplayPrivate *d, uint32_t *dst,
+				   int32_t width, int32_t height, GlueDisplayOrigin origin)
+{
+    GluePipeline *p = d->pipeline;
+    pixman_region32_t region;
+    pixman_box32_t *extents;
+    gint64 n_pixels;
+    ScaleJob job;
+
+    glue_scaler_setup(&p->scaler, d->width, d->height, width, height);
+    pixman_region32_init(&region);
+    glue_scaler_map_region(&p->scaler, &region, &p->invalidate_region);
+    pixman_region32_copy(&p->invalidate_region, &region);
+    pixman_region32_fini(&region);
+
+    job.d = d;
+    job.rects = pixman_region32_rectangles(&p->invalidate_region, &job.n_rects);
+    if (origin == GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT) {
+	job.dst = dst + (gint64)(height - 1) * width;
+	job.dst_step = -width;
+    } else {
+	job.dst = dst;
+	job.dst_step = width;
+    }
+    n_pixels = count_pixels(job.rects, job.n_rects);
+    if (n_pixels == 0)
+	return 0;
+
+    /* Weight the work by the source pixels read */
+    extents = pixman_region32_extents(&p->invalidate_region);
+    glue_stripes_run(scale_stripe_to_glue, &job, extents->y1, extents->y2,
+		     n_pixels * d->width / width * d->height / height);
+    return n_pixels;
+}
+
+/* Brings the back buffer up to date and publishes it. It does not take
+ * the pipeline lock, the host takes the frame with glue_triple_buffer_acquire() */
+static void copy_display_to_triple_buffer(SpiceDisplayPrivate *d, gint64 now_timestamp,
+					  GlueDisplayOrigin origin)
+{
+    GluePipeline *p = d->pipeline;
+    GlueFrameBuffer *back;
+    gint64 n_pixels;
+    gboolean replaced;
+
+    glue_triple_buffer_resize(&p->triple_buffer, d->width, d->height);
+    back = glue_triple_buffer_get_back(&p->triple_buffer);
+
+    /* Copy also what changed while this buffer was published */
+    pixman_region32_union(&back->pending, &back->pending, &p->invalidate_region);
+    n_pixels = copy_region_to_glue(d, back->pixels, &back->pending, origin);
+    pixman_region32_clear(&back->pending);
+
+    replaced = glue_triple_buffer_publish(&p->triple_buffer, &p->invalidate_region,
+					  p->frame_sequence + 1);
+    glue_stats_frame_published(p->first_invalidate, now_timestamp, n_pixels,
+			       g_get_monotonic_time() - now_timestamp, replaced);
+}
+
+/* Brings the back slot of the shared frames up to date and publishes it.
+ * Called with the pipeline lock held, after glue_shm_resize() */
+static void copy_display_to_shm(SpiceDisplayPrivate *d, gint64 locked_timestamp,
+				GlueDisplayOrigin origin)
+{
+    GluePipeline *p = d->pipeline;
+    pixman_region32_t *pending;
+    uint32_t *pixels;
+    gint64 n_pixels;
+
+    pixels = glue_shm_begin_frame(&p->shm, &pending);
+    pixman_region32_union(pending, pending, &p->invalidate_region);
+    n_pixels = copy_region_to_glue(d, pixels, pending, origin);
+    pixman_region32_clear(pending);
+
+    glue_shm_publish(&p->shm, &p->invalidate_region, p->frame_sequence + 1, origin);
+    /* Frames taken by the reader process are not known */
+    glue_stats_frame_published(p->first_invalidate, locked_timestamp, n_pixels,
+			       g_get_monotonic_time() - locked_timestamp, FALSE);
+}
+
+/* Drops the copy source until the surface or the host buffers are ready.
+ * The damage stays pending; primary_create() and spice_display_resume_copy()
+ * arm the copy again, as well as the next damage */
+static gboolean wait_for_host(GluePipeline *p)
+{
+    p->copy_source = NULL;
+    return G_SOURCE_REMOVE;
+}
+
+/* Tells the host that a new frame is ready. Called with the pipeline lock held,
+ * except in GLUE_DISPLAY_EXPORT_TRIPLE_BUFFER mode */
+static void publish_frame(SpiceDisplayPrivate *d, GlueDisplayExportMode mode,
+			  gint64 now_timestamp)
+{
+    GluePipeline *p = d->pipeline;
+
+    p->first_invalidate = 0;
+    if (g_atomic_int_get(&glue_input_tracing))
+	glue_trace_frame_published(&p->input_trace, g_get_monotonic_time());
+
+    if (mode == GLUE_DISPLAY_EXPORT_COPY || mode == GLUE_DISPLAY_EXPORT_SURFACE) {
+	/* Reported by SpiceGlibGlueGetDirtyRects() */
+	pixman_region32_union(&p->published_region, &p->published_region,
+			      &p->invalidate_region);
+	if (pixman_region32_n_rects(&p->published_region) > GLUE_MAX_DIRTY_RECTS) {
+	    pixman_box32_t extents = *pixman_region32_extents(&p->published_region);
+	    pixman_region32_reset(&p->published_region, &extents);
+	}
+    }
+    pixman_region32_clear(&p->invalidate_region);
+    if (mode == GLUE_DISPLAY_EXPORT_SURFACE || mode == GLUE_DISPLAY_EXPORT_SHARED_MEMORY) {
+	/* These frames are never scaled */
+	p->frame_width = d->width;
+	p->frame_height = d->height;
+    }
+
+    p->last_copy_timestamp = now_timestamp;
+    p->copy_source = NULL;
+    p->invalidated = FALSE;
+    p->frame_sequence++;
+    /* Frames of the other modes are not taken with take_published_frame() */
+    g_atomic_int_set(&p->updated,
+		     mode == GLUE_DISPLAY_EXPORT_COPY || mode == GLUE_DISPLAY_EXPORT_SURFACE);
+
+    glue_timeline_step(&d->glue_session->timeline, GLUE_CONNECT_FIRST_FRAME);
+}
+
+/* Enabled with SpiceGlibGlueSetTileHashing() */
+extern volatile gint glue_tile_hashing;
+
+/* Removes from the pending damage the tiles whose pixels have not really
+ * changed. It must be called right before copying the frame, so that the
+ * hashes always describe what the host has got.
+ * Returns FALSE if nothing has changed; then the frame is dropped. */
+static gboolean filter_unchanged_tiles(SpiceDisplayPrivate *d, gint64 now_timestamp)
+{
+    GluePipeline *p = d->pipeline;
+    GlueTileCounters counters = { 0, 0, 0 };
+
+    if (!g_atomic_int_get(&glue_tile_hashing)) {
+	/* The hashes would be stale when it is enabled again */
+	if (p->tile_hashes.hashes != NULL)
+	    glue_tiles_clear(&p->tile_hashes);
 	return TRUE;
     }
 
+    glue_tiles_filter(&p->tile_hashes, &p->invalidate_region, d->data, d->width,
+		      d->height, d->stride, d->bytes_per_pixel, &counters);
+    glue_stats_tiles(counters.tiles_hashed, counters.tiles_suppressed,
+		     counters.bytes_suppressed);
+    if (pixman_region32_not_empty(&p->invalidate_region))
+	return TRUE;
+
+    /* Like publish_frame(), but the host keeps the current frame */
+    p->last_copy_timestamp = now_timestamp;
+    p->copy_source = NULL;
+    p->invalidated = FALSE;
+    return FALSE;
+}
+
+/* Takes the pipeline lock, recording how long the host kept us waiting.
+ * Returns the time when the lock was taken. */
+static gint64 lock_display(GluePipeline *p, gint64 now_timestamp)
+{
+    gint64 locked_timestamp;
+
+    g_mutex_lock(&p->lock);
+    locked_timestamp = g_get_monotonic_time();
+    glue_stats_lock_wait(locked_timestamp - now_timestamp);
+    return locked_timestamp;
+}
+
+static gboolean copy_display_to_glue(gpointer data)
+{
+    SpiceDisplayPrivate *d = data;
+    GluePipeline *p = d->pipeline;
+    /* The host may change them meanwhile, this frame is published as it started */
+    GlueDisplayExportMode mode = g_atomic_int_get(&glue_export_mode);
+    GlueDisplayOrigin origin = g_atomic_int_get(&glue_display_origin);
+    gint64 now_timestamp = g_get_monotonic_time();
+    gint64 locked_timestamp, n_pixels;
+    int32_t frame_width, frame_height;
+
     if (d->data == NULL || d->width == 0 || d->height == 0) {
 	SPICE_DEBUG("local display is not available");
-	return TRUE;
+	return wait_for_host(p);
     }
 
-    if (local_width != d->width || local_height != d->height) {
-	SPICE_DEBUG("local dimensions changed since scheduled\n");
-	return TRUE;
+    if (p->local_width != d->width || p->local_height != d->height) {
+	/* The damage belongs to the previous surface, copy the new one whole */
+	SPICE_DEBUG("local dimensions changed since scheduled");
+	pixman_region32_reset(&p->invalidate_region,
+			      &(pixman_box32_t){ 0, 0, d->width, d->height });
+	p->local_width = d->width;
+	p->local_height = d->height;
     }
 
-    if (glue_width < local_width || glue_height < local_height) {
+    if (mode == GLUE_DISPLAY_EXPORT_SURFACE) {
+	/* The host reads d->data itself, just tell it there is a new frame */
+	lock_display(p, now_timestamp);
+	if (!filter_unchanged_tiles(d, now_timestamp)) {
+	    g_mutex_unlock(&p->lock);
+	    return G_SOURCE_REMOVE;
+	}
+	glue_stats_frame_published(p->first_invalidate, now_timestamp, 0, 0, p->updated);
+	publish_frame(d, mode, now_timestamp);
+	g_mutex_unlock(&p->lock);
+	glue_notify_frame_ready(p->channel_id, p->monitor_id, p->frame_sequence);
+	return G_SOURCE_REMOVE;
+    }
+
+    if (mode == GLUE_DISPLAY_EXPORT_SHARED_MEMORY) {
+	locked_timestamp = lock_display(p, now_timestamp);
+	if (!glue_shm_resize(&p->shm, d->width, d->height)) {
+	    g_mutex_unlock(&p->lock);
+	    SPICE_DEBUG("shared frames are not available or too small");
+	    return wait_for_host(p);
+	}
+	if (!filter_unchanged_tiles(d, now_timestamp)) {
+	    g_mutex_unlock(&p->lock);
+	    return G_SOURCE_REMOVE;
+	}
+	copy_display_to_shm(d, locked_timestamp, origin);
+	publish_frame(d, mode, now_timestamp);
+	g_mutex_unlock(&p->lock);
+	glue_notify_frame_ready(p->channel_id, p->monitor_id, p->frame_sequence);
+	return G_SOURCE_REMOVE;
+    }
+
+    if (mode == GLUE_DISPLAY_EXPORT_TRIPLE_BUFFER) {
+	if (!filter_unchanged_tiles(d, now_timestamp))
+	    return G_SOURCE_REMOVE;
+	copy_display_to_triple_buffer(d, now_timestamp, origin);
+	if (p->frame_width != d->width || p->frame_height != d->height) {
+	    /* The host reads the frame size with the lock held */
+	    g_mutex_lock(&p->lock);
+	    p->frame_width = d->width;
+	    p->frame_height = d->height;
+	    g_mutex_unlock(&p->lock);
+	}
+	publish_frame(d, mode, now_timestamp);
+	glue_notify_frame_ready(p->channel_id, p->monitor_id, p->frame_sequence);
+	return G_SOURCE_REMOVE;
+    }
+
+    /* The host sets its buffer with the lock held */
+    locked_timestamp = lock_display(p, now_timestamp);
+
+    get_frame_size(d, mode, &frame_width, &frame_height);
+    if (p->buffer == NULL) {
+	g_mutex_unlock(&p->lock);
+	SPICE_DEBUG("glue display buffer is not initialized yet");
+	return wait_for_host(p);
+    }
+    if (p->buffer_width < frame_width || p->buffer_height < frame_height) {
+	g_mutex_unlock(&p->lock);
 	SPICE_DEBUG("glue display dimensions are too small");
-	return TRUE;
+	return wait_for_host(p);
     }
 
-    if (glue_display_buffer == NULL) {
-        SPICE_DEBUG("glue_display_buffer is not initialized yet");
-        return TRUE;
+    if (frame_width == p->copied_width && frame_height == p->copied_height &&
+	!filter_unchanged_tiles(d, now_timestamp)) {
+	g_mutex_unlock(&p->lock);
+	return G_SOURCE_REMOVE;
     }
+    if (frame_width != p->copied_width || frame_height != p->copied_height) {
+	/* The scale or the host buffer has changed, copy the whole surface;
+	 * the hashes no longer describe what the host has got */
+	pixman_region32_reset(&p->invalidate_region,
+			      &(pixman_box32_t){ 0, 0, d->width, d->height });
+	glue_tiles_reset(&p->tile_hashes);
+	p->copied_width = frame_width;
+	p->copied_height = frame_height;
+    }
+    p->frame_width = frame_width;
+    p->frame_height = frame_height;
 
-    STATIC_MUTEX_LOCK(glue_display_lock);
-    Color32 * src2_data = (Color32 *)d->data;
-    Color32 * dst2_data = (Color32 *)glue_display_buffer;
-    int maxI = d->height > (invalidate_y + invalidate_h)? d->height - invalidate_y : invalidate_h;
-    int maxJ = d->width  > (invalidate_x + invalidate_w)? d->width :(invalidate_x + invalidate_w);
-    src2_data += d->width * invalidate_y;
-#if defined(__APPLE__) || defined(ANDROID)
-    int tmp = (d->height - invalidate_y - 1) * d->width;
-    dst2_data += tmp;
-#else
-    dst2_data += d->width * invalidate_y;
-#endif
+    if (frame_width == d->width && frame_height == d->height)
+	n_pixels = copy_region_to_glue(d, p->buffer, &p->invalidate_region, origin);
+    else
+	n_pixels = scale_region_to_glue(d, p->buffer, frame_width, frame_height, origin);
+    glue_stats_frame_published(p->first_invalidate, now_timestamp, n_pixels,
+			       g_get_monotonic_time() - locked_timestamp,
+			       p->updated);
+    publish_frame(d, mode, now_timestamp);
+
+    g_mutex_unlock(&p->lock);
+    glue_notify_frame_ready(p->channel_id, p->monitor_id, p->frame_sequence);
+    return G_SOURCE_REMOVE;
+}
 
-    int i, j;
-    for (i = 0 ; i < maxI; i++) {
-	for (j = invalidate_x; j < maxJ; j ++) {
-	    dst2_data[j]=ARGBtoABGR(src2_data[j]);
-	}
-#if defined(__APPLE__) || defined(ANDROID)
-	dst2_data-= d->width;
-#else
-	dst2_data+= d->width;
-#endif
-	src2_data += d->width;
-    }
+static gboolean copy_source_dispatch(GSource *source, GSourceFunc callback,
+				     gpointer user_data)
+{
+    return callback(user_data);
+}
 
-    last_copy_timestamp= now_timestamp;
-    copy_scheduled = 0;
-    invalidated = FALSE;
-    updatedDisplayBuffer = TRUE;
+static GSourceFuncs copy_source_funcs = {
+    NULL, NULL, copy_source_dispatch, NULL
+};
 
+/* Arms the copy source of the pipeline to run at its next allowed frame
+ * deadline, so that the main loop sleeps until then instead of polling for it.
+ * Each monitor has its own deadline. */
+static void schedule_copy(SpiceDisplayPrivate *d)
+{
+    GluePipeline *p = d->pipeline;
 
-    STATIC_MUTEX_UNLOCK(glue_display_lock);
-    return FALSE;
+    if (p->copy_source != NULL)
+	return;
+
+    p->copy_source = g_source_new(&copy_source_funcs, sizeof(GSource));
+    g_source_set_callback(p->copy_source, copy_display_to_glue, d, NULL);
+    g_source_set_ready_time(p->copy_source,
+			    p->last_copy_timestamp + g_atomic_int_get(&glue_frame_interval));
+    g_source_attach(p->copy_source, NULL);
+    g_source_unref(p->copy_source);
 }
 
-/* Called when we receive a new display image.
- * Sets invalidated = TRUE, and updates the values of invalidate_x/y/w/h that
- * store the coordinates of the area to copy_display_to_glue().
+/* Arms the copy again if it was waiting for the host. Called from the main
+ * loop when the host sets a new buffer, export mode or scaling */
+void spice_display_resume_copy(SpiceDisplay *display)
+{
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
+
+    if (d->display != NULL && d->pipeline->invalidated)
+	schedule_copy(d);
+}
+
+static void cancel_copy(SpiceDisplayPrivate *d)
+{
+    GluePipeline *p = d->pipeline;
+
+    if (p->copy_source == NULL)
+	return;
+
+    g_source_destroy(p->copy_source);
+    p->copy_source = NULL;
+    p->invalidated = FALSE;
+}
+
+/* Called when we receive a new display image, in surface coordinates.
+ * Damage out of the area of the monitor is ignored, the rest is translated
+ * to monitor coordinates.
+ * Sets invalidated = TRUE, and adds the area to the invalidate_region of the
+ * pipeline, which stores the rectangles to copy in copy_display_to_glue().
+ * When the region grows beyond GLUE_MAX_DIRTY_RECTS rectangles, it is
+ * coalesced into its bounding box, so that it does not grow unbounded.
  *
  * We don't know if display_glue has been modified. We don't care.
  * */
@@ -1031,56 +2049,46 @@ static void invalidate(SpiceChannel *channel,
                        gint x, gint y, gint w, gint h, gpointer data)
 {
     SpiceDisplay *display = SPICE_DISPLAY(data);
-    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(global_display);
-    char *cdata = (char *)d->data;
-    
-    if (invalidated == TRUE) {
-	/*SPICE_DEBUG("*** 0000 PRE inval x: %d, w: %d, y: %d, h: %d",
-	  invalidate_x, invalidate_w, invalidate_y, invalidate_h );
-	  SPICE_DEBUG("*** **** PRE nuevo x: %d, w: %d, y: %d, h: %d",
-	  x, w, y, h );*/
-	if (local_width != d->width ||
-	    local_height != d->height) {
-	    invalidate_x = 0;
-	    invalidate_y = 0;
-	    invalidate_w = d->width;
-	    invalidate_h = d->height;
-	    local_width = d->width;
-	    local_height = d->height;
-	} else {
-	    gint invalidate_x0 = invalidate_x;
-	    gint invalidate_y0 = invalidate_y;
-	    if (x < invalidate_x)
-		invalidate_x = x;
-	    if (y < invalidate_y)
-		invalidate_y = y;
-	    if ((x + w) > (invalidate_x0 + invalidate_w))
-		invalidate_w = (x + w) - invalidate_x;
-	    if ((y + h) > (invalidate_y0 + invalidate_h))
-		invalidate_h = (y + h) - invalidate_y;
-	}
-
-	if (glue_display_buffer == NULL) {
-	    SPICE_DEBUG("glue_display_buffer not yet initialized");
-	    return;
-	}
+    SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
+    GluePipeline *p = d->pipeline;
+    gint64 now = g_get_monotonic_time();
 
-	/*SPICE_DEBUG("*** **** POST inval x: %d, w: %d, y: %d, h: %d, &x: %xd",
-	  invalidate_x, invalidate_w, invalidate_y, invalidate_h, &invalidate_x );*/
-    } else {
-	invalidated = TRUE;
-	invalidate_x = x;
-	invalidate_y = y;
-	invalidate_w = w;
-	invalidate_h = h;
-	local_width = d->width;
-	local_height = d->height;
-    }
+    x -= d->area_x;
+    y -= d->area_y;
+    if (x >= d->width || y >= d->height || x + w <= 0 || y + h <= 0)
+	return;
 
-    if (!copy_scheduled) {
-	g_idle_add((GSourceFunc) copy_display_to_glue, (gpointer) d);
-	copy_scheduled = 1;
-    }
+    glue_stats_invalidate();
+    if (p->first_invalidate == 0)
+	p->first_invalidate = now;
+    if (g_atomic_int_get(&glue_input_tracing))
+	glue_trace_damage(&p->input_trace, now, x, y, w, h);
+
+    if (p->invalidated == TRUE &&
+	(p->local_width != d->width || p->local_height != d->height)) {
+	/* The surface has been resized, copy it whole */
+	x = 0;
+	y = 0;
+	w = d->width;
+	h = d->height;
+	pixman_region32_clear(&p->invalidate_region);
+    } else if (p->invalidated == FALSE) {
+	p->invalidated = TRUE;
+	pixman_region32_clear(&p->invalidate_region);
+    }
+    p->local_width = d->width;
+    p->local_height = d->height;
+
+    pixman_region32_union_rect(&p->invalidate_region, &p->invalidate_region, x, y, w, h);
+    pixman_region32_intersect_rect(&p->invalidate_region, &p->invalidate_region,
+				   0, 0, d->width, d->height);
+
+    if (pixman_region32_n_rects(&p->invalidate_region) > GLUE_MAX_DIRTY_RECTS) {
+	pixman_box32_t extents = *pixman_region32_extents(&p->invalidate_region);
+	pixman_region32_reset(&p->invalidate_region, &extents);
+    }
+
+    schedule_copy(d);
 }
 
 static void update_ready(SpiceDisplay *display)
@@ -1107,6 +2115,8 @@ static void mark(SpiceDisplay *display, gint mark)
 
     SPICE_DEBUG("widget mark: %d, %d:%d %p", mark, d->channel_id, d->monitor_id, display);
     d->mark = mark;
+    if (mark != 0)
+	glue_timeline_step(&d->glue_session->timeline, GLUE_CONNECT_DISPLAY_MARK);
     update_ready(display);
 }
 
@@ -1121,32 +2131,19 @@ typedef struct _SpiceGlibGlueCursorData
     //int32_t* rgba;
 } SpiceGlibGlueCursorData;
 
-MonoGlueCursor* monoglue_cursor_new_from_data(uint32_t width, uint32_t height, uint32_t hot_x, uint32_t hot_y, uint32_t* rgba) {
-
-    MonoGlueCursor* ret = g_new(MonoGlueCursor, 1);
-    ret->width=  width;
-    ret->height= height;
-    ret->hot_x=  hot_x;
-    ret->hot_y=  hot_y;
-    ret->rgba= g_memdup(rgba, width * height * 4);
-
-    return ret;
-}
-
-MonoGlueCursor* get_blank_cursor() {
-
-    uint32_t imagen[1]={0};
-    return monoglue_cursor_new_from_data(1, 1, 0, 0, imagen);
-}
-
-void monoglue_cursor_finalize(MonoGlueCursor* c) {
-    if (c) {
-	if (c->rgba) {
-	    g_free(c->rgba);
-	    c->rgba= NULL;
-	}
-	g_free(c);
-    }
+/* Publishes the cursor to the readers of d->cursor_state. The fields it
+ * reads are only written from the main loop, where it is called */
+static void publish_cursor_state(SpiceDisplayPrivate *d)
+{
+    MonoGlueCursorState state;
+
+    /* The guest moves it in surface coordinates */
+    state.x = d->mouse_guest_x == -1 ? -1 : d->mouse_guest_x - d->area_x;
+    state.y = d->mouse_guest_y == -1 ? -1 : d->mouse_guest_y - d->area_y;
+    state.visible = d->cursor_view.shape != NULL && d->cursor_view.visible;
+    state.mouse_mode = d->mouse_mode;
+    state.cursor_id = d->cursor_view.id;
+    glue_cursor_state_publish(&d->cursor_state, &state);
 }
 
 static void cursor_set(SpiceCursorChannel *channel,
@@ -1158,36 +2155,31 @@ static void cursor_set(SpiceCursorChannel *channel,
       buttonId, eventX, eventY, buttonState);*/
     SpiceDisplay *display = data;
     SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
-    MonoGlueCursor *cursor = NULL;
+    GlueCursor *cursor;
 
     STATIC_MUTEX_LOCK(d->cursor_lock);
 
-    if (rgba != NULL) {
-	cursor= monoglue_cursor_new_from_data(width, height, hot_x, hot_y, rgba);
-    } else
+    if (rgba == NULL) {
 	g_warn_if_reached();
-
-    if (d->show_cursor) {
-	monoglue_cursor_finalize(d->show_cursor);
-	d->show_cursor = NULL;
-	if (d->mouse_mode == SPICE_MOUSE_MODE_SERVER) {
-	    SPICE_DEBUG("%s pointer copying cursor image to show_cursor:", __FUNCTION__);
-	    /* keep a hidden cursor, will be shown in cursor_move() */
-	    d->show_cursor= monoglue_cursor_new_from_data(width, height, hot_x, hot_y, rgba);
-	    goto end;
-	}
+	goto end;
     }
+    /* Shapes seen before are not copied again */
+    cursor = glue_cursor_cache_lookup(&d->cursor_cache, width, height, hot_x, hot_y, rgba);
 
-    monoglue_cursor_finalize(d->mouse_cursor);
-
-    d->mouse_cursor = cursor;
-    SPICE_DEBUG("%s : w: %d, h: %d, v[0] %04x", __FUNCTION__,
-		cursor->width, cursor->height, cursor->rgba[0]);
+    if (!d->cursor_view.visible && d->mouse_mode == SPICE_MOUSE_MODE_SERVER) {
+	/* keep a hidden cursor, will be shown in cursor_move() */
+	SPICE_DEBUG("%s pointer keeping cursor image hidden", __FUNCTION__);
+    } else {
+	d->cursor_view.visible = TRUE;
+    }
 
-    (d->idCursor)++;
+    glue_cursor_view_set_shape(&d->cursor_view, cursor);
+    SPICE_DEBUG("%s : w: %d, h: %d, id %u", __FUNCTION__,
+		width, height, cursor->id);
 
  end:
     STATIC_MUTEX_UNLOCK(d->cursor_lock);
+    publish_cursor_state(d);
 }
 
 static void cursor_move(SpiceCursorChannel *channel, gint x, gint y, gpointer data)
@@ -1197,27 +2189,20 @@ static void cursor_move(SpiceCursorChannel *channel, gint x, gint y, gpointer da
     SPICE_DEBUG("%s: x %d, y %d d->mouse_guest_x: %d d->mouse_guest_y: %d ",
 		__FUNCTION__, x, y, d->mouse_guest_x, d->mouse_guest_y);
 
-
-    STATIC_MUTEX_LOCK(d->cursor_lock);
-
     /* In server mode, we receive mouse location via cursor-channel */
     d->mouse_guest_x = x;
     d->mouse_guest_y = y;
 
-    /* apparently we have to restore cursor when "cursor_move" */
-    if (d->show_cursor != NULL) {
-	//gdk_cursor_unref(d->mouse_cursor);
-	if (d->mouse_cursor) {
-	    monoglue_cursor_finalize(d->mouse_cursor);
-	    d->mouse_cursor=NULL;
-	}
-	d->mouse_cursor = d->show_cursor;
-	d->show_cursor = NULL;
-	//SPICE_DEBUG("%s not update_mouse_pointer",  __FUNCTION__);
+    /* apparently we have to restore cursor when "cursor_move".
+     * cursor_view.visible is only written from the main loop, so it can be
+     * checked without the lock, which is only needed to show it again */
+    if (!d->cursor_view.visible) {
+	STATIC_MUTEX_LOCK(d->cursor_lock);
+	glue_cursor_view_set_visible(&d->cursor_view, TRUE);
+	STATIC_MUTEX_UNLOCK(d->cursor_lock);
     }
-    SPICE_DEBUG("%s exiting critical section",  __FUNCTION__);
 
-    STATIC_MUTEX_UNLOCK(d->cursor_lock);
+    publish_cursor_state(d);
 }
 
 static void cursor_hide(SpiceCursorChannel *channel, gpointer data)
@@ -1225,17 +2210,15 @@ static void cursor_hide(SpiceCursorChannel *channel, gpointer data)
     SpiceDisplay *display = data;
     SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
 
-    STATIC_MUTEX_LOCK(d->cursor_lock);
     SPICE_DEBUG("cursor_hide()");
 
-    if (d->show_cursor != NULL) /* then we are already hidden */
-	goto end;
+    if (!d->cursor_view.visible) /* then we are already hidden */
+	return;
 
-    //cursor_invalidate(display);
-    d->show_cursor = d->mouse_cursor;
-    d->mouse_cursor = get_blank_cursor();
- end:
+    STATIC_MUTEX_LOCK(d->cursor_lock);
+    glue_cursor_view_set_visible(&d->cursor_view, FALSE);
     STATIC_MUTEX_UNLOCK(d->cursor_lock);
+    publish_cursor_state(d);
 }
 
 static void cursor_reset(SpiceCursorChannel *channel, gpointer data)
@@ -1246,40 +2229,30 @@ static void cursor_reset(SpiceCursorChannel *channel, gpointer data)
     STATIC_MUTEX_LOCK(d->cursor_lock);
     SPICE_DEBUG("%s",  __FUNCTION__);
 
-    if (d->mouse_cursor) {
-	monoglue_cursor_finalize(d->mouse_cursor);
-	d->mouse_cursor = NULL;
-    }
-    if (d->show_cursor) {
-	monoglue_cursor_finalize(d->show_cursor);
-	d->show_cursor = NULL;
-    }
+    d->cursor_view.visible = TRUE;
+    glue_cursor_view_set_shape(&d->cursor_view, NULL);
 
     STATIC_MUTEX_UNLOCK(d->cursor_lock);
+    publish_cursor_state(d);
     //gdk_window_set_cursor(window, NULL);
 }
 
-int16_t SpiceGlibGlueGetCursor(uint32_t previousCursorId,
-			       uint32_t* currentCursorId,
-			       uint32_t* showInClient,
-			       SpiceGlibGlueCursorData* cursor,
-			       int32_t* dstRgba)
+static int16_t get_display_cursor(SpiceDisplay *display, uint32_t previousCursorId,
+				  uint32_t* currentCursorId, uint32_t* showInClient,
+				  SpiceGlibGlueCursorData* cursor, int32_t* dstRgba)
 {
-    SpiceDisplay *display;
     SpiceDisplayPrivate *d;
+    MonoGlueCursorState state;
 
-    if (global_display == NULL) {
-	return -1;
-    }
-
-    display = global_display;
     d = SPICE_DISPLAY_GET_PRIVATE(display);
 
     if (d->data == NULL) {
 	return -1;
     }
 
-    switch (d->mouse_mode) {
+    /* mouse_mode is written by the main loop, read its published copy */
+    glue_cursor_state_read(&d->cursor_state, &state);
+    switch (state.mouse_mode) {
     case SPICE_MOUSE_MODE_CLIENT:
 	*showInClient=true;
 	break;
@@ -1293,9 +2266,10 @@ int16_t SpiceGlibGlueGetCursor(uint32_t previousCursorId,
 
     STATIC_MUTEX_LOCK(d->cursor_lock);
 
-    if (previousCursorId!=d->idCursor) {
+    if (previousCursorId!=d->cursor_view.id) {
 	SPICE_DEBUG("%s : Changing cursor ", __FUNCTION__);
-	MonoGlueCursor* mgc = d->mouse_cursor;
+	const GlueCursor *shown = glue_cursor_view_get_shown(&d->cursor_view);
+	const MonoGlueCursor* mgc = shown != NULL ? &shown->cursor : NULL;
 	if (mgc) {
 	    cursor->width= mgc->width;
 	    cursor->height= mgc->height;
@@ -1309,11 +2283,61 @@ int16_t SpiceGlibGlueGetCursor(uint32_t previousCursorId,
 	}
     }
 
+    *currentCursorId = d->cursor_view.id;
     STATIC_MUTEX_UNLOCK(d->cursor_lock);
-    *currentCursorId = d->idCursor;
     return 0;
 }
 
+/* Drops the reference to display taken by the caller */
+static int16_t get_cursor(SpiceDisplay *display, uint32_t previousCursorId,
+			  uint32_t* currentCursorId, uint32_t* showInClient,
+			  SpiceGlibGlueCursorData* cursor, int32_t* dstRgba)
+{
+    int16_t result;
+
+    if (display == NULL) {
+	return -1;
+    }
+
+    result = get_display_cursor(display, previousCursorId, currentCursorId,
+				showInClient, cursor, dstRgba);
+    g_object_unref(display);
+    return result;
+}
+
+/**
+ * Gets the cursor image if it is not the one the host already has.
+ * Params:
+ *  previousCursorId: id returned by the previous call, 0 the first time.
+ *  OUT: *currentCursorId: id of the shape of the current cursor, 0 if there
+ *  is none. The same shape keeps its id while the glue caches it, so the
+ *  host can cache its native cursors by id too.
+ *  OUT: *cursor, dstRgba: size, hot spot and pixels, only written when the
+ *  id has changed. dstRgba must have room for the biggest cursor.
+ * Returns 0, or -1 if there is no display.
+ **/
+int16_t SpiceGlibGlueGetCursor(uint32_t previousCursorId,
+			       uint32_t* currentCursorId,
+			       uint32_t* showInClient,
+			       SpiceGlibGlueCursorData* cursor,
+			       int32_t* dstRgba)
+{
+    return get_cursor(glue_ref_global_display(), previousCursorId, currentCursorId,
+		      showInClient, cursor, dstRgba);
+}
+
+/* Like SpiceGlibGlueGetCursor(), for the cursor channel of the given monitor */
+int16_t SpiceGlibGlueGetCursorFor(int32_t channel_id, int32_t monitor_id,
+				  uint32_t previousCursorId,
+				  uint32_t* currentCursorId,
+				  uint32_t* showInClient,
+				  SpiceGlibGlueCursorData* cursor,
+				  int32_t* dstRgba)
+{
+    return get_cursor(glue_pipeline_ref_display(channel_id, monitor_id),
+		      previousCursorId, currentCursorId, showInClient, cursor, dstRgba);
+}
+
 static void disconnect_main(SpiceDisplay *display)
 {
     SpiceDisplayPrivate *d = SPICE_DISPLAY_GET_PRIVATE(display);
@@ -1330,7 +2354,13 @@ static void disconnect_display(SpiceDisplay *display)
     if (d->display == NULL)
 	return;
 
+    /* For the next connection to the same server */
+    g_mutex_lock(&d->pipeline->lock);
+    keep_last_surface(d);
+    g_mutex_unlock(&d->pipeline->lock);
     primary_destroy(d->display, display);
+    cancel_copy(d);
+    glue_pipeline_detach(d->pipeline, display);
 
     g_signal_handlers_disconnect_by_func(d->display, G_CALLBACK(primary_create),
 					 display);
@@ -1350,15 +2380,15 @@ static void disconnect_cursor(SpiceDisplay *display)
 
     //cursor_destroy(d->display, display); eh?
 
-    g_signal_handlers_disconnect_by_func(d->display, G_CALLBACK(cursor_set),
+    g_signal_handlers_disconnect_by_func(d->cursor, G_CALLBACK(cursor_set),
 					 display);
-    g_signal_handlers_disconnect_by_func(d->display, G_CALLBACK(cursor_move),
+    g_signal_handlers_disconnect_by_func(d->cursor, G_CALLBACK(cursor_move),
 					 display);
-    g_signal_handlers_disconnect_by_func(d->display, G_CALLBACK(cursor_hide),
+    g_signal_handlers_disconnect_by_func(d->cursor, G_CALLBACK(cursor_hide),
 					 display);
-    g_signal_handlers_disconnect_by_func(d->display, G_CALLBACK(cursor_reset),
+    g_signal_handlers_disconnect_by_func(d->cursor, G_CALLBACK(cursor_reset),
 					 display);
-    d->display = NULL;
+    d->cursor = NULL;
 }
 
 
@@ -1389,7 +2419,7 @@ static void channel_new(SpiceSession *s, SpiceChannel *channel, gpointer data)
     if (SPICE_IS_DISPLAY_CHANNEL(channel)) {
 	//SPICE_DEBUG(" ***** channel_new: ES DISPLAY_CHANEL del display %d ", get_display_id(display));
 	SpiceDisplayPrimary primary;
-	if (id != d->channel_id)
+	if (id != d->channel_id || d->pipeline == NULL)
 	    return;
 	d->display = channel;
 	g_signal_connect(channel, "display-primary-create",
@@ -1408,7 +2438,9 @@ static void channel_new(SpiceSession *s, SpiceChannel *channel, gpointer data)
 			   primary.stride, primary.shmid, primary.data, display);
 	    mark(display, primary.marked);
 	}
-	spice_channel_connect(channel);
+	/* The displays of the other monitors come once it is connected */
+	if (d->monitor_id == 0)
+	    spice_channel_connect(channel);
 	spice_main_set_display_enabled(d->main, get_display_id(display), TRUE);
 	return;
     }
@@ -1427,14 +2459,18 @@ static void channel_new(SpiceSession *s, SpiceChannel *channel, gpointer data)
 			 G_CALLBACK(cursor_hide), display);
 	g_signal_connect(channel, "cursor-reset",
 			 G_CALLBACK(cursor_reset), display);
-	spice_channel_connect(channel);
+	if (d->monitor_id == 0)
+	    spice_channel_connect(channel);
 	return;
     }
 
     if (SPICE_IS_INPUTS_CHANNEL(channel)) {
 	//SPICE_DEBUG(" ***** channel_new: ES INPUTS_CHANEL del display %d ", get_display_id(display));
+	g_mutex_lock(&d->motion_lock);
 	d->inputs = SPICE_INPUTS_CHANNEL(channel);
-	spice_channel_connect(channel);
+	g_mutex_unlock(&d->motion_lock);
+	if (d->monitor_id == 0)
+	    spice_channel_connect(channel);
 	sync_keyboard_lock_modifiers(display);
 	return;
     }
@@ -1482,7 +2518,9 @@ static void channel_destroy(SpiceSession *s, SpiceChannel *channel, gpointer dat
     }
 
     if (SPICE_IS_INPUTS_CHANNEL(channel)) {
+	g_mutex_lock(&d->motion_lock);
 	d->inputs = NULL;
+	g_mutex_unlock(&d->motion_lock);
 	return;
     }
 
@@ -1499,11 +2537,14 @@ static void channel_destroy(SpiceSession *s, SpiceChannel *channel, gpointer dat
 /**
  * spice_display_new:
  * @session: a #SpiceSession
+ * @glue_session: the #GlueSession of @session
  * @id: the display channel ID to associate with #SpiceDisplay
+ * @monitor_id: the monitor of the display channel it shows
  *
  * Returns: a new #SpiceDisplay widget.
  **/
-SpiceDisplay *spice_display_new(SpiceSession *session, int id)
+SpiceDisplay *spice_display_new(SpiceSession *session, GlueSession *glue_session,
+				int id, int monitor_id)
 {
     SpiceDisplay *display;
     SpiceDisplayPrivate *d;
@@ -1513,8 +2554,24 @@ SpiceDisplay *spice_display_new(SpiceSession *session, int id)
     display = g_object_new(SPICE_TYPE_DISPLAY, NULL);
     d = SPICE_DISPLAY_GET_PRIVATE(display);
     d->session = g_object_ref(session);
+    d->glue_session = glue_session;
+    d->server_generation = glue_session->server_generation;
     d->channel_id = id;
-    SPICE_DEBUG("channel_id:%d",d->channel_id);
+    d->monitor_id = monitor_id;
+    SPICE_DEBUG("channel_id:%d monitor_id:%d", d->channel_id, d->monitor_id);
+
+    /* Each monitor exports its area of the primary surface of the channel */
+    d->pipeline = glue_session_get_pipeline(glue_session, id, monitor_id);
+    if (d->pipeline != NULL)
+	glue_pipeline_attach(d->pipeline, display);
+    else
+	g_warning("display %d:%d has no display pipeline", id, monitor_id);
+    /* The API without a channel id acts on the first display of the default session */
+    g_mutex_lock(&global_display_lock);
+    if (glue_session == glue_session_default() && monitor_id == 0 &&
+	(id == 0 || global_display == NULL))
+	global_display = display;
+    g_mutex_unlock(&global_display_lock);
 
     g_signal_connect(session, "channel-new",
 		     G_CALLBACK(channel_new), display);
@@ -1572,8 +2629,10 @@ static void sync_keyboard_lock_modifiers(SpiceDisplay *display)
 
     x_display = GDK_WINDOW_XDISPLAY(w);
     modifiers = get_keyboard_lock_modifiers(x_display);
+    g_mutex_lock(&d->motion_lock);
     if (d->inputs)
 	spice_inputs_set_key_locks(d->inputs, modifiers);
+    g_mutex_unlock(&d->motion_lock);
 }
 
 #elif defined (WIN32)
@@ -1603,8 +2662,10 @@ static void sync_keyboard_lock_modifiers(SpiceDisplay *display)
 	return;
 
     modifiers = get_keyboard_lock_modifiers();
+    g_mutex_lock(&d->motion_lock);
     if (d->inputs)
 	spice_inputs_set_key_locks(d->inputs, modifiers);
+    g_mutex_unlock(&d->motion_lock);
 }
 #else
 static void sync_keyboard_lock_modifiers(SpiceDisplay *display)
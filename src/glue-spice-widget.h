@@ -37,6 +37,8 @@ G_BEGIN_DECLS
 typedef struct _SpiceDisplay SpiceDisplay;
 typedef struct _SpiceDisplayClass SpiceDisplayClass;
 typedef struct _SpiceDisplayPrivate SpiceDisplayPrivate;
+/* Defined in glue-session.h */
+typedef struct _GlueSession GlueSession;
 
 struct _SpiceDisplay {
     SpiceChannel parent;
@@ -67,10 +69,12 @@ typedef enum {
 
 GType spice_display_get_type(void);
 
-SpiceDisplay* spice_display_new(SpiceSession *session, int id);
+SpiceDisplay* spice_display_new(SpiceSession *session, GlueSession *glue_session,
+				int id, int monitor_id);
 void spice_display_send_keys(SpiceDisplay *display, const guint *keyvals,
 			     int nkeyvals, SpiceDisplayKeyEvent kind);
 void send_key(SpiceDisplay *display, int scancode, int down);
+void spice_display_resume_copy(SpiceDisplay *display);
 
 G_END_DECLS
 
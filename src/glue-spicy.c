@@ -39,17 +39,18 @@ static void connection_destroy(spice_connection *conn);
 
 /* ------------------------------------------------------------------ */
 
-static SpiceWindow *create_spice_window(spice_connection *conn, SpiceChannel *channel, int id)
+static SpiceWindow *create_spice_window(spice_connection *conn, SpiceChannel *channel,
+					int id, gint monitor_id)
 {
     SpiceWindow *win;
 
     win = g_new0 (SpiceWindow, 1);
     win->id = id;
-    //win->monitor_id = monitor_id;
+    win->monitor_id = monitor_id;
     win->conn = conn;
     win->display_channel = channel;
 
-    win->spice = (spice_display_new(conn->session, id));
+    win->spice = (spice_display_new(conn->session, conn->glue_session, id, monitor_id));
     return win;
 }
 
@@ -62,7 +63,11 @@ static void destroy_spice_window(SpiceWindow *win)
     //g_object_unref(win->ag);
     //g_object_unref(win->ui);
     //gtk_widget_destroy(win->toplevel);
-    g_object_unref(win);
+    /* The host may still hold a reference for a moment; let go of the
+     * channels here, in the main loop, and not in the last unref */
+    g_object_run_dispose(G_OBJECT(win->spice));
+    g_object_unref(win->spice);
+    g_free(win);
 }
 
 static void main_channel_event(SpiceChannel *channel, SpiceChannelEvent event,
@@ -178,6 +183,41 @@ static void generic_channel_event(SpiceChannel *channel, SpiceChannelEvent event
     }
 }
 
+/* One window per monitor of the display channel; the window of monitor 0
+ * is created with the channel and stays until it is destroyed */
+static void display_monitors(SpiceChannel *display, GParamSpec *pspec,
+                             spice_connection *conn)
+{
+    GArray *monitors = NULL;
+    int id;
+    guint i;
+
+    g_object_get(display,
+                 "channel-id", &id,
+                 "monitors", &monitors,
+                 NULL);
+    g_return_if_fail(monitors != NULL);
+
+    for (i = 1; i < monitors->len && i < MONITORID_MAX; i++) {
+        SpiceWindow *w = conn->wins[id * MONITORID_MAX + i];
+
+        if (w == NULL) {
+            SPICE_DEBUG("new display monitor (#%d:%d)", id, i);
+            conn->wins[id * MONITORID_MAX + i] = create_spice_window(conn, display, id, i);
+        }
+    }
+
+    for (i = MAX(monitors->len, 1); i < MONITORID_MAX; i++) {
+        if (conn->wins[id * MONITORID_MAX + i] == NULL)
+            continue;
+        SPICE_DEBUG("zap display monitor (#%d:%d)", id, i);
+        destroy_spice_window(conn->wins[id * MONITORID_MAX + i]);
+        conn->wins[id * MONITORID_MAX + i] = NULL;
+    }
+
+    g_clear_pointer(&monitors, g_array_unref);
+}
+
 static void main_mouse_update(SpiceChannel *channel, gpointer data)
 {
     spice_connection *conn = data;
@@ -197,6 +237,25 @@ static void main_mouse_update(SpiceChannel *channel, gpointer data)
     }
 }
 
+/* The server sends the mouse mode in the init message of the main channel */
+static void main_init_received(SpiceChannel *channel, gpointer data)
+{
+    spice_connection *conn = data;
+
+    glue_timeline_step(&conn->glue_session->timeline, GLUE_CONNECT_MAIN_INIT);
+}
+
+/* Connected to every channel by channel_new() */
+static void timeline_channel_event(SpiceChannel *channel, SpiceChannelEvent event,
+				   gpointer data)
+{
+    spice_connection *conn = data;
+    int type, id;
+
+    g_object_get(channel, "channel-type", &type, "channel-id", &id, NULL);
+    glue_timeline_channel_event(&conn->glue_session->timeline, type, id, event);
+}
+
 static void main_agent_update(SpiceChannel *channel, gpointer data)
 {
     spice_connection *conn = data;
@@ -209,12 +268,16 @@ static void main_agent_update(SpiceChannel *channel, gpointer data)
 static void channel_new(SpiceSession *s, SpiceChannel *channel, gpointer data)
 {
     spice_connection *conn = data;
-    int id;
+    int id, type;
 
-    g_object_get(channel, "channel-id", &id, NULL);
+    g_object_get(channel, "channel-id", &id, "channel-type", &type, NULL);
     conn->channels++;
     SPICE_DEBUG("new channel (#%d)", id);
 
+    glue_timeline_channel_new(&conn->glue_session->timeline, type, id);
+    g_signal_connect(channel, "channel-event",
+                     G_CALLBACK(timeline_channel_event), conn);
+
     if (SPICE_IS_MAIN_CHANNEL(channel)) {
         SPICE_DEBUG("new main channel");
         conn->main = SPICE_MAIN_CHANNEL(channel);
@@ -224,18 +287,22 @@ static void channel_new(SpiceSession *s, SpiceChannel *channel, gpointer data)
                          G_CALLBACK(main_mouse_update), conn);
         g_signal_connect(channel, "main-agent-update",
                          G_CALLBACK(main_agent_update), conn);
+        g_signal_connect(channel, "main-mouse-update",
+                         G_CALLBACK(main_init_received), conn);
         main_mouse_update(channel, conn);
         main_agent_update(channel, conn);
     }
 
     if (SPICE_IS_DISPLAY_CHANNEL(channel)) {
-        if (id >= SPICE_N_ELEMENTS(conn->wins))
+        if (id >= CHANNELID_MAX)
             return;
-        if (conn->wins[id] != NULL)
+        if (conn->wins[id * MONITORID_MAX] != NULL)
             return;
         SPICE_DEBUG("new display channel (#%d)", id);
-        conn->wins[id] = create_spice_window(conn, channel, id);
-        SPICE_DEBUG("display-mark not connected Aqui el original conecta display_monitors");
+        conn->wins[id * MONITORID_MAX] = create_spice_window(conn, channel, id, 0);
+        g_signal_connect(channel, "notify::monitors",
+                         G_CALLBACK(display_monitors), conn);
+        SPICE_DEBUG("display-mark not connected");
         //g_signal_connect(channel, "display-mark",
         //                 G_CALLBACK(display_mark), conn->wins[id]); Mostrar / ocultar imagen cuando lo pide el spice server
         //update_auto_usbredir_sensitive(conn);
@@ -251,7 +318,7 @@ static void channel_new(SpiceSession *s, SpiceChannel *channel, gpointer data)
                          G_CALLBACK(generic_channel_event), conn);
     }
 
-    if (soundEnabled && SPICE_IS_PLAYBACK_CHANNEL(channel)) {
+    if (conn->glue_session->sound_enabled && SPICE_IS_PLAYBACK_CHANNEL(channel)) {
         SPICE_DEBUG("new audio channel");
         conn->audio = spice_audio_get(s, NULL);
         g_signal_connect(channel, "channel-event",
@@ -285,16 +352,21 @@ static void channel_destroy(SpiceSession *s, SpiceChannel *channel, gpointer dat
     }
 
     if (SPICE_IS_DISPLAY_CHANNEL(channel)) {
-        if (id >= SPICE_N_ELEMENTS(conn->wins))
-            return;
-        if (conn->wins[id] == NULL)
+        int i;
+
+        if (id >= CHANNELID_MAX)
             return;
-        SPICE_DEBUG("zap display channel (#%d)", id);
-        destroy_spice_window(conn->wins[id]);
-        conn->wins[id] = NULL;
+        g_signal_handlers_disconnect_by_func(channel, G_CALLBACK(display_monitors), conn);
+        for (i = 0; i < MONITORID_MAX; i++) {
+            if (conn->wins[id * MONITORID_MAX + i] == NULL)
+                continue;
+            SPICE_DEBUG("zap display channel (#%d:%d)", id, i);
+            destroy_spice_window(conn->wins[id * MONITORID_MAX + i]);
+            conn->wins[id * MONITORID_MAX + i] = NULL;
+        }
     }
 
-    if (soundEnabled && SPICE_IS_PLAYBACK_CHANNEL(channel)) {
+    if (conn->glue_session->sound_enabled && SPICE_IS_PLAYBACK_CHANNEL(channel)) {
         SPICE_DEBUG("zap audio channel");
     }
 
@@ -328,13 +400,22 @@ static void migration_state(GObject *session,
         g_message("migrating session");
 }
 
-spice_connection *connection_new(void)
+spice_connection *connection_new(GlueSession *glue_session)
 {
     spice_connection *conn;
     //SpiceUsbDeviceManager *manager;
 
     conn = g_new0(spice_connection, 1);
-    conn->session = spice_session_new();
+    conn->glue_session = glue_session;
+    /* The session of the last connection keeps its configuration, unless
+     * that connection is still going away */
+    if (glue_session->spice_session != NULL && glue_session->connections > 0) {
+        g_object_unref(glue_session->spice_session);
+        glue_session->spice_session = NULL;
+    }
+    if (glue_session->spice_session == NULL)
+        glue_session->spice_session = spice_session_new();
+    conn->session = g_object_ref(glue_session->spice_session);
     g_signal_connect(conn->session, "channel-new",
                      G_CALLBACK(channel_new), conn);
     g_signal_connect(conn->session, "channel-destroy",
@@ -350,8 +431,8 @@ spice_connection *connection_new(void)
     //                     G_CALLBACK(usb_connect_failed), NULL);
     //}
 
-    connections++;
-    SPICE_DEBUG("%s (%d)", __FUNCTION__, connections);
+    glue_session->connections++;
+    SPICE_DEBUG("%s (%d)", __FUNCTION__, glue_session->connections);
     return conn;
 }
 
@@ -363,24 +444,27 @@ void connection_connect(spice_connection *conn)
 
 void connection_disconnect(spice_connection *conn)
 {
-    if (conn->disconnecting || global_disconnecting)
+    if (conn->disconnecting || conn->glue_session->disconnecting)
         return;
     conn->disconnecting = true;
     spice_session_disconnect(conn->session);
 }
 
-extern spice_connection *mainconn;
-
 static void connection_destroy(spice_connection *conn)
 {
+    GlueSession *glue_session = conn->glue_session;
+
     SPICE_DEBUG("glue-spicy: connection_destroy()");
-    mainconn = NULL;
+    if (glue_session->conn == conn)
+        glue_session->conn = NULL;
+    /* The session may be reused by the next connection */
+    g_signal_handlers_disconnect_by_data(conn->session, conn);
     g_object_unref(conn->session);
     free(conn);
 
-    connections--;
-    SPICE_DEBUG("%s (%d)", __FUNCTION__, connections);
-    if (connections > 0) {
+    glue_session->connections--;
+    SPICE_DEBUG("%s (%d)", __FUNCTION__, glue_session->connections);
+    if (glue_session->connections > 0) {
         return;
     }
 
@@ -410,8 +494,23 @@ void spice_session_setup(SpiceSession *session, const char *host,
         g_object_set(session, "ws-port", ws_port, NULL);
     if (password)
         g_object_set(session, "password", password, NULL);
-    if (ca_file)
-        g_object_set(session, "ca-file", ca_file, NULL);
+    if (ca_file) {
+        gchar *ca;
+        gsize length;
+        GError *error = NULL;
+
+        /* Read once, the channels of every reconnection take it from memory */
+        if (g_file_get_contents(ca_file, &ca, &length, &error)) {
+            GByteArray *ca_data = g_byte_array_new_take((guint8 *)ca, length);
+
+            g_object_set(session, "ca", ca_data, NULL);
+            g_byte_array_unref(ca_data);
+        } else {
+            SPICE_DEBUG("cannot read %s: %s", ca_file, error->message);
+            g_clear_error(&error);
+            g_object_set(session, "ca-file", ca_file, NULL);
+        }
+    }
     if (cert_subj)
         g_object_set(session, "cert-subject", cert_subj, NULL);
 }
@@ -31,6 +31,7 @@
 #include <spice-gtk/spice-common.h>
 
 #include "glue-spice-widget.h"
+#include "glue-session.h"
 
 typedef struct spice_connection spice_connection;
 
@@ -84,6 +85,7 @@ struct spice_connection {
     gboolean         agent_connected;
     int              channels;
     int              disconnecting;
+    GlueSession      *glue_session;
 };
 
 void spice_session_setup(SpiceSession *session, const char *host,
@@ -94,7 +96,7 @@ void spice_session_setup(SpiceSession *session, const char *host,
 			 const char *ca_file,
 			 const char *cert_subj);
 
-spice_connection *connection_new(void);
+spice_connection *connection_new(GlueSession *glue_session);
 void connection_connect(spice_connection *conn);
 void connection_disconnect(spice_connection *conn);
 
@@ -0,0 +1,320 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Always-on counters of the display pipeline and the input events. Counters
+ * are updated with atomic operations, so that an event costs no lock; only
+ * the histograms, which the host reads as percentiles, are kept under a
+ * mutex. Counters are gsize, they wrap at 4G on 32 bits hosts.
+ */
+
+#include <string.h>
+
+#include "glue-stats.h"
+
+/* Each power of two is split in 4 buckets: 4..4, 5..5, ..., 8..9, 10..11, ... */
+static int histogram_bucket(gint64 usecs)
+{
+    int e;
+
+    if (usecs < 4)
+	return usecs < 0 ? 0 : usecs;
+    if (usecs > G_MAXINT32)
+	usecs = G_MAXINT32;
+    e = g_bit_storage(usecs) - 1;
+    return 4 * (e - 1) + ((usecs >> (e - 2)) & 3);
+}
+
+/* Largest value stored in a bucket */
+static guint32 histogram_bucket_limit(int bucket)
+{
+    int e = bucket / 4 + 1;
+
+    if (bucket < 4)
+	return bucket;
+    return ((guint32)(4 + bucket % 4 + 1) << (e - 2)) - 1;
+}
+
+void glue_histogram_add(GlueHistogram *h, gint64 usecs)
+{
+    h->buckets[histogram_bucket(usecs)]++;
+    h->count++;
+}
+
+guint32 glue_histogram_percentile(const GlueHistogram *h, int percentile)
+{
+    guint64 target, sum = 0;
+    int i;
+
+    if (h->count == 0)
+	return 0;
+
+    target = ((guint64)h->count * percentile + 99) / 100;
+    for (i = 0; i < GLUE_HISTOGRAM_BUCKETS; i++) {
+	sum += h->buckets[i];
+	if (sum >= target && sum > 0)
+	    return histogram_bucket_limit(i);
+    }
+    return histogram_bucket_limit(GLUE_HISTOGRAM_BUCKETS - 1);
+}
+
+void glue_histogram_get(const GlueHistogram *h, MonoGluePercentiles *p)
+{
+    p->count = h->count;
+    p->p50 = glue_histogram_percentile(h, 50);
+    p->p95 = glue_histogram_percentile(h, 95);
+    p->p99 = glue_histogram_percentile(h, 99);
+}
+
+#define counter_add(counter, n) g_atomic_pointer_add(&(counter), (gssize)(n))
+#define counter_get(counter) ((gsize)g_atomic_pointer_get(&(counter)))
+#define counter_reset(counter) g_atomic_pointer_set(&(counter), NULL)
+
+static struct {
+    volatile gsize invalidations;
+    volatile gsize frames_copied;
+    volatile gsize frames_skipped;
+    volatile gsize pixels_copied;
+    volatile gsize tiles_hashed;
+    volatile gsize tiles_suppressed;
+    volatile gsize bytes_suppressed;
+    /* Protects the fields below */
+    GMutex        lock;
+    gint64        reset_time;
+    GlueHistogram copy_time;
+    GlueHistogram lock_wait;
+    GlueHistogram pickup_latency;
+    /* First invalidation of the oldest frame not taken by the host yet */
+    gint64        first_unpicked;
+} display_stats;
+
+static struct {
+    volatile gsize motion_received;
+    volatile gsize motion_sent;
+    volatile gsize traces_expired;
+    volatile gsize input_dropped;
+    /* Protects the fields below, and the input traces */
+    GMutex        lock;
+    gint64        reset_time;
+    GlueHistogram input_to_send;
+    GlueHistogram input_to_damage;
+    GlueHistogram input_to_frame;
+} input_stats;
+
+void glue_stats_init(void)
+{
+    g_mutex_init(&display_stats.lock);
+    g_mutex_init(&input_stats.lock);
+    glue_stats_reset_display();
+    glue_stats_reset_input();
+}
+
+void glue_stats_invalidate(void)
+{
+    counter_add(display_stats.invalidations, 1);
+}
+
+void glue_stats_lock_wait(gint64 usecs)
+{
+    g_mutex_lock(&display_stats.lock);
+    glue_histogram_add(&display_stats.lock_wait, usecs);
+    g_mutex_unlock(&display_stats.lock);
+}
+
+/* first_invalidate is the first damage of the frame, 0 if unknown.
+ * n_pixels is 0 when the frame is not copied (GLUE_DISPLAY_EXPORT_SURFACE).
+ * replaced is TRUE if the previous frame had not been taken yet. */
+void glue_stats_frame_published(gint64 first_invalidate, gint64 now, gint64 n_pixels,
+				gint64 copy_usecs, gboolean replaced)
+{
+    counter_add(display_stats.frames_copied, 1);
+    if (replaced)
+	counter_add(display_stats.frames_skipped, 1);
+    if (n_pixels > 0)
+	counter_add(display_stats.pixels_copied, n_pixels);
+
+    g_mutex_lock(&display_stats.lock);
+    if (n_pixels > 0)
+	glue_histogram_add(&display_stats.copy_time, copy_usecs);
+    if (display_stats.first_unpicked == 0)
+	display_stats.first_unpicked = first_invalidate ? first_invalidate : now;
+    g_mutex_unlock(&display_stats.lock);
+}
+
+void glue_stats_tiles(guint64 hashed, guint64 suppressed, guint64 bytes)
+{
+    counter_add(display_stats.tiles_hashed, hashed);
+    counter_add(display_stats.tiles_suppressed, suppressed);
+    counter_add(display_stats.bytes_suppressed, bytes);
+}
+
+void glue_stats_frame_picked_up(gint64 now)
+{
+    g_mutex_lock(&display_stats.lock);
+    if (display_stats.first_unpicked != 0) {
+	glue_histogram_add(&display_stats.pickup_latency,
+			   now - display_stats.first_unpicked);
+	display_stats.first_unpicked = 0;
+    }
+    g_mutex_unlock(&display_stats.lock);
+}
+
+void glue_stats_get_display(GlueDisplayStats *stats)
+{
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(&display_stats.lock);
+    stats->elapsed_usecs = now - display_stats.reset_time;
+    stats->invalidations = counter_get(display_stats.invalidations);
+    stats->frames_copied = counter_get(display_stats.frames_copied);
+    stats->frames_skipped = counter_get(display_stats.frames_skipped);
+    stats->pixels_copied = counter_get(display_stats.pixels_copied);
+    stats->pixels_per_second = stats->elapsed_usecs > 0 ?
+	stats->pixels_copied * G_USEC_PER_SEC / stats->elapsed_usecs : 0;
+    stats->tiles_hashed = counter_get(display_stats.tiles_hashed);
+    stats->tiles_suppressed = counter_get(display_stats.tiles_suppressed);
+    stats->bytes_suppressed = counter_get(display_stats.bytes_suppressed);
+    glue_histogram_get(&display_stats.copy_time, &stats->copy_time);
+    glue_histogram_get(&display_stats.lock_wait, &stats->lock_wait);
+    glue_histogram_get(&display_stats.pickup_latency, &stats->pickup_latency);
+    g_mutex_unlock(&display_stats.lock);
+}
+
+/* Frames in flight keep their timestamps, so that their pickup is measured */
+void glue_stats_reset_display(void)
+{
+    g_mutex_lock(&display_stats.lock);
+    display_stats.reset_time = g_get_monotonic_time();
+    counter_reset(display_stats.invalidations);
+    counter_reset(display_stats.frames_copied);
+    counter_reset(display_stats.frames_skipped);
+    counter_reset(display_stats.pixels_copied);
+    counter_reset(display_stats.tiles_hashed);
+    counter_reset(display_stats.tiles_suppressed);
+    counter_reset(display_stats.bytes_suppressed);
+    memset(&display_stats.copy_time, 0, sizeof(GlueHistogram));
+    memset(&display_stats.lock_wait, 0, sizeof(GlueHistogram));
+    memset(&display_stats.pickup_latency, 0, sizeof(GlueHistogram));
+    g_mutex_unlock(&display_stats.lock);
+}
+
+void glue_stats_motion_received(void)
+{
+    counter_add(input_stats.motion_received, 1);
+}
+
+void glue_stats_motion_sent(void)
+{
+    counter_add(input_stats.motion_sent, 1);
+}
+
+void glue_stats_get_input(GlueInputStats *stats)
+{
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(&input_stats.lock);
+    stats->elapsed_usecs = now - input_stats.reset_time;
+    stats->motion_received = counter_get(input_stats.motion_received);
+    stats->motion_sent = counter_get(input_stats.motion_sent);
+    stats->traces_expired = counter_get(input_stats.traces_expired);
+    stats->input_dropped = counter_get(input_stats.input_dropped);
+    glue_histogram_get(&input_stats.input_to_send, &stats->input_to_send);
+    glue_histogram_get(&input_stats.input_to_damage, &stats->input_to_damage);
+    glue_histogram_get(&input_stats.input_to_frame, &stats->input_to_frame);
+    g_mutex_unlock(&input_stats.lock);
+}
+
+void glue_stats_reset_input(void)
+{
+    g_mutex_lock(&input_stats.lock);
+    input_stats.reset_time = g_get_monotonic_time();
+    counter_reset(input_stats.motion_received);
+    counter_reset(input_stats.motion_sent);
+    counter_reset(input_stats.traces_expired);
+    counter_reset(input_stats.input_dropped);
+    memset(&input_stats.input_to_send, 0, sizeof(GlueHistogram));
+    memset(&input_stats.input_to_damage, 0, sizeof(GlueHistogram));
+    memset(&input_stats.input_to_frame, 0, sizeof(GlueHistogram));
+    g_mutex_unlock(&input_stats.lock);
+}
+
+void glue_stats_input_sent(gint64 received, gint64 now)
+{
+    g_mutex_lock(&input_stats.lock);
+    glue_histogram_add(&input_stats.input_to_send, now - received);
+    g_mutex_unlock(&input_stats.lock);
+}
+
+void glue_stats_input_dropped(void)
+{
+    counter_add(input_stats.input_dropped, 1);
+}
+
+/* A trace still waiting for damage after the timeout gets no response */
+static void expire_trace(GlueInputTrace *trace, gint64 now)
+{
+    if (trace->received != 0 && trace->damaged == 0 &&
+	now - trace->received > GLUE_INPUT_TRACE_TIMEOUT) {
+	counter_add(input_stats.traces_expired, 1);
+	trace->received = 0;
+    }
+}
+
+/* Starts following the event. It replaces a trace without damage, like
+ * client mode motion, which draws no damage; one with damage is kept
+ * until its frame is published. */
+void glue_trace_input(GlueInputTrace *trace, gint64 received,
+		      gboolean has_position, gint x, gint y)
+{
+    g_mutex_lock(&input_stats.lock);
+    expire_trace(trace, received);
+    if (trace->damaged == 0) {
+	trace->received = received;
+	trace->has_position = has_position;
+	trace->x = x;
+	trace->y = y;
+    }
+    g_mutex_unlock(&input_stats.lock);
+}
+
+void glue_trace_damage(GlueInputTrace *trace, gint64 now,
+		       gint x, gint y, gint width, gint height)
+{
+    g_mutex_lock(&input_stats.lock);
+    if (trace->received != 0 && trace->damaged == 0 &&
+	(!trace->has_position ||
+	 (x < trace->x + GLUE_INPUT_TRACE_RADIUS && trace->x - GLUE_INPUT_TRACE_RADIUS < x + width &&
+	  y < trace->y + GLUE_INPUT_TRACE_RADIUS && trace->y - GLUE_INPUT_TRACE_RADIUS < y + height))) {
+	trace->damaged = now;
+	glue_histogram_add(&input_stats.input_to_damage, now - trace->received);
+    }
+    g_mutex_unlock(&input_stats.lock);
+}
+
+/* The damage received so far is in the published frame */
+void glue_trace_frame_published(GlueInputTrace *trace, gint64 now)
+{
+    g_mutex_lock(&input_stats.lock);
+    if (trace->damaged != 0) {
+	glue_histogram_add(&input_stats.input_to_frame, now - trace->received);
+	trace->received = 0;
+	trace->damaged = 0;
+    } else {
+	expire_trace(trace, now);
+    }
+    g_mutex_unlock(&input_stats.lock);
+}
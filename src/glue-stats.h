@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_STATS_H_
+#define GLUE_STATS_H_
+
+#include "glib.h"
+#include "mono-glue-types.h"
+
+/* Histogram of times in microseconds, with a resolution of 25% */
+#define GLUE_HISTOGRAM_BUCKETS 128
+
+typedef struct {
+    guint32 buckets[GLUE_HISTOGRAM_BUCKETS];
+    guint32 count;
+} GlueHistogram;
+
+void glue_histogram_add(GlueHistogram *h, gint64 usecs);
+/* Upper bound of the given percentile (0-100), 0 if the histogram is empty */
+guint32 glue_histogram_percentile(const GlueHistogram *h, int percentile);
+void glue_histogram_get(const GlueHistogram *h, MonoGluePercentiles *p);
+
+void glue_stats_init(void);
+
+/* Display pipeline events, called from the GLib main loop */
+void glue_stats_invalidate(void);
+void glue_stats_lock_wait(gint64 usecs);
+void glue_stats_frame_published(gint64 first_invalidate, gint64 now, gint64 n_pixels,
+				gint64 copy_usecs, gboolean replaced);
+void glue_stats_tiles(guint64 hashed, guint64 suppressed, guint64 bytes);
+/* Called when the host takes a new frame */
+void glue_stats_frame_picked_up(gint64 now);
+
+void glue_stats_get_display(GlueDisplayStats *stats);
+void glue_stats_reset_display(void);
+
+/* Input events, called from any thread */
+void glue_stats_motion_received(void);
+void glue_stats_motion_sent(void);
+/* An input event that entered the glue at received has been sent */
+void glue_stats_input_sent(gint64 received, gint64 now);
+void glue_stats_input_dropped(void);
+
+/* Damage around the pointer position that counts as a response */
+#define GLUE_INPUT_TRACE_RADIUS 64
+/* Traces without a response are dropped after this time */
+#define GLUE_INPUT_TRACE_TIMEOUT G_USEC_PER_SEC
+
+/*
+ * Input event of a display followed until its response is on screen. Only
+ * one is followed at a time: a new event replaces the one being followed
+ * until damage arrives, then the next events are not followed until that
+ * damage is published. Protected by the lock of the input statistics.
+ */
+typedef struct {
+    /* When the event entered the glue, 0 if none is being followed */
+    gint64   received;
+    /* When damage near the event arrived, 0 until then */
+    gint64   damaged;
+    /* Pointer position; key events have none and take any damage */
+    gboolean has_position;
+    gint     x, y;
+} GlueInputTrace;
+
+void glue_trace_input(GlueInputTrace *trace, gint64 received,
+		      gboolean has_position, gint x, gint y);
+void glue_trace_damage(GlueInputTrace *trace, gint64 now,
+		       gint x, gint y, gint width, gint height);
+void glue_trace_frame_published(GlueInputTrace *trace, gint64 now);
+
+void glue_stats_get_input(GlueInputStats *stats);
+void glue_stats_reset_input(void);
+
+#endif /* GLUE_STATS_H_ */
@@ -0,0 +1,142 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Persistent worker pool to split display conversions in horizontal stripes.
+ *
+ * The pool is only used from the GLib main loop thread, which also
+ * converts one of the stripes before waiting for the others.
+ */
+
+#include <spice-gtk/spice-util.h>
+
+#include "glue-stripes.h"
+
+#define GLUE_STRIPES_MAX_THREADS 32
+
+/* Do not split jobs with less pixels per stripe than this */
+#define GLUE_STRIPES_MIN_PIXELS (256 * 256)
+
+typedef struct {
+    GlueStripeFunc func;
+    gpointer       data;
+    GMutex         lock;
+    GCond          done;
+    int            pending;
+} StripeJob;
+
+typedef struct {
+    StripeJob *job;
+    int       y1, y2;
+} Stripe;
+
+static GThreadPool *pool = NULL;
+static int pool_threads = 1;
+static volatile gint requested_threads = 1;
+
+static void run_stripe(gpointer data, gpointer user_data)
+{
+    Stripe *stripe = data;
+    StripeJob *job = stripe->job;
+
+    job->func(job->data, stripe->y1, stripe->y2);
+
+    g_mutex_lock(&job->lock);
+    if (--job->pending == 0)
+	g_cond_signal(&job->done);
+    g_mutex_unlock(&job->lock);
+}
+
+void glue_stripes_init(void)
+{
+    /* g_get_num_processors() counts logical CPUs; assume two per core */
+    glue_stripes_set_threads(g_get_num_processors() / 4);
+}
+
+void glue_stripes_set_threads(int n_threads)
+{
+    g_atomic_int_set(&requested_threads,
+		     CLAMP(n_threads, 1, GLUE_STRIPES_MAX_THREADS));
+}
+
+/* Creates the pool again if the number of threads has changed */
+static void update_pool(void)
+{
+    int n_threads = g_atomic_int_get(&requested_threads);
+
+    if (n_threads == pool_threads)
+	return;
+
+    if (pool != NULL) {
+	g_thread_pool_free(pool, FALSE, TRUE);
+	pool = NULL;
+    }
+    if (n_threads > 1) {
+	GError *error = NULL;
+	pool = g_thread_pool_new(run_stripe, NULL, n_threads - 1, TRUE, &error);
+	if (pool == NULL) {
+	    g_warning("Could not start the conversion threads: %s", error->message);
+	    g_clear_error(&error);
+	    n_threads = 1;
+	}
+    }
+    SPICE_DEBUG("Using %d conversion threads", n_threads);
+    pool_threads = n_threads;
+}
+
+void glue_stripes_run(GlueStripeFunc func, gpointer data, int y1, int y2,
+		      gint64 n_pixels)
+{
+    Stripe stripes[GLUE_STRIPES_MAX_THREADS];
+    StripeJob job;
+    int i, n_stripes, rows;
+
+    update_pool();
+
+    n_stripes = MIN(pool_threads, n_pixels / GLUE_STRIPES_MIN_PIXELS);
+    n_stripes = MIN(n_stripes, y2 - y1);
+    if (n_stripes <= 1) {
+	func(data, y1, y2);
+	return;
+    }
+
+    job.func = func;
+    job.data = data;
+    job.pending = n_stripes - 1;
+    g_mutex_init(&job.lock);
+    g_cond_init(&job.done);
+
+    rows = y2 - y1;
+    for (i = 0; i < n_stripes; i++) {
+	stripes[i].job = &job;
+	stripes[i].y1 = y1 + rows * i / n_stripes;
+	stripes[i].y2 = y1 + rows * (i + 1) / n_stripes;
+    }
+    /* The first stripe is converted in this thread */
+    for (i = 1; i < n_stripes; i++) {
+	g_thread_pool_push(pool, &stripes[i], NULL);
+    }
+    func(data, stripes[0].y1, stripes[0].y2);
+
+    g_mutex_lock(&job.lock);
+    while (job.pending > 0)
+	g_cond_wait(&job.done, &job.lock);
+    g_mutex_unlock(&job.lock);
+
+    g_mutex_clear(&job.lock);
+    g_cond_clear(&job.done);
+}
@@ -0,0 +1,39 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_STRIPES_H_
+#define GLUE_STRIPES_H_
+
+#include "glib.h"
+
+/* Processes rows [y1, y2) of some image */
+typedef void (*GlueStripeFunc)(gpointer data, int y1, int y2);
+
+/* Sets the default number of threads: half the physical cores */
+void glue_stripes_init(void);
+
+/* Sets the number of threads used by glue_stripes_run(), including the
+ * calling one. 1 disables the worker pool. It can be called from any thread. */
+void glue_stripes_set_threads(int n_threads);
+
+/* Splits rows [y1, y2) into horizontal stripes and runs func on each of
+ * them in parallel, returning when all of them are done. n_pixels is the
+ * amount of work, small jobs are run in the calling thread. */
+void glue_stripes_run(GlueStripeFunc func, gpointer data, int y1, int y2,
+		      gint64 n_pixels);
+
+#endif /* GLUE_STRIPES_H_ */
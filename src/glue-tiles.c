@@ -0,0 +1,140 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Change detection of the primary surface by tiles, to drop the damage
+ * of display-invalidate signals that do not change any pixel.
+ */
+
+#include <string.h>
+
+#include "glue-tiles.h"
+
+#define HASH_PRIME G_GUINT64_CONSTANT(0x9E3779B97F4A7C15)
+
+void glue_tiles_init(GlueTileHashes *tiles)
+{
+    memset(tiles, 0, sizeof(*tiles));
+}
+
+void glue_tiles_clear(GlueTileHashes *tiles)
+{
+    g_free(tiles->hashes);
+    g_free(tiles->valid);
+    glue_tiles_init(tiles);
+}
+
+void glue_tiles_reset(GlueTileHashes *tiles)
+{
+    if (tiles->valid != NULL)
+	memset(tiles->valid, 0, tiles->columns * tiles->rows * sizeof(gboolean));
+}
+
+/* (Re)allocates the tables for a new image */
+static void tiles_setup(GlueTileHashes *tiles, gconstpointer data,
+			int width, int height, int stride)
+{
+    glue_tiles_clear(tiles);
+    tiles->data = data;
+    tiles->width = width;
+    tiles->height = height;
+    tiles->stride = stride;
+    tiles->columns = (width + GLUE_TILE_SIZE - 1) / GLUE_TILE_SIZE;
+    tiles->rows = (height + GLUE_TILE_SIZE - 1) / GLUE_TILE_SIZE;
+    tiles->hashes = g_new(guint64, tiles->columns * tiles->rows);
+    tiles->valid = g_new0(gboolean, tiles->columns * tiles->rows);
+}
+
+/* Multiplicative hash of a block of rows, 8 bytes at a time */
+static guint64 hash_tile(const guint8 *data, int stride, int row_bytes, int rows)
+{
+    guint64 h = HASH_PRIME, word;
+    int x, y;
+
+    for (y = 0; y < rows; y++, data += stride) {
+	for (x = 0; x + 8 <= row_bytes; x += 8) {
+	    memcpy(&word, data + x, 8);
+	    h = (h ^ word) * HASH_PRIME;
+	    h ^= h >> 29;
+	}
+	if (x < row_bytes) {
+	    word = 0;
+	    memcpy(&word, data + x, row_bytes - x);
+	    h = (h ^ word) * HASH_PRIME;
+	    h ^= h >> 29;
+	}
+    }
+    return h;
+}
+
+void glue_tiles_filter(GlueTileHashes *tiles, pixman_region32_t *damage,
+		       gconstpointer data, int width, int height, int stride,
+		       int bytes_per_pixel, GlueTileCounters *counters)
+{
+    pixman_box32_t extents = *pixman_region32_extents(damage);
+    pixman_region32_t unchanged;
+    int column, row;
+
+    if (data != tiles->data || width != tiles->width ||
+	height != tiles->height || stride != tiles->stride)
+	tiles_setup(tiles, data, width, height, stride);
+
+    pixman_region32_init(&unchanged);
+    for (row = extents.y1 / GLUE_TILE_SIZE;
+	 row < tiles->rows && row * GLUE_TILE_SIZE < extents.y2; row++) {
+	for (column = extents.x1 / GLUE_TILE_SIZE;
+	     column < tiles->columns && column * GLUE_TILE_SIZE < extents.x2; column++) {
+	    pixman_box32_t tile = {
+		column * GLUE_TILE_SIZE, row * GLUE_TILE_SIZE,
+		MIN((column + 1) * GLUE_TILE_SIZE, width),
+		MIN((row + 1) * GLUE_TILE_SIZE, height)
+	    };
+	    int i = row * tiles->columns + column;
+	    guint64 hash;
+
+	    if (pixman_region32_contains_rectangle(damage, &tile) == PIXMAN_REGION_OUT)
+		continue;
+
+	    hash = hash_tile((const guint8 *)data + (gint64)tile.y1 * stride +
+			     tile.x1 * bytes_per_pixel, stride,
+			     (tile.x2 - tile.x1) * bytes_per_pixel, tile.y2 - tile.y1);
+	    counters->tiles_hashed++;
+	    if (tiles->valid[i] && tiles->hashes[i] == hash) {
+		pixman_region32_union_rect(&unchanged, &unchanged, tile.x1, tile.y1,
+					   tile.x2 - tile.x1, tile.y2 - tile.y1);
+		counters->tiles_suppressed++;
+	    } else {
+		tiles->hashes[i] = hash;
+		tiles->valid[i] = TRUE;
+	    }
+	}
+    }
+
+    if (pixman_region32_not_empty(&unchanged)) {
+	pixman_box32_t *boxes;
+	int i, n_boxes;
+
+	pixman_region32_intersect(&unchanged, &unchanged, damage);
+	boxes = pixman_region32_rectangles(&unchanged, &n_boxes);
+	for (i = 0; i < n_boxes; i++) {
+	    counters->bytes_suppressed += (guint64)(boxes[i].x2 - boxes[i].x1) *
+		(boxes[i].y2 - boxes[i].y1) * sizeof(uint32_t);
+	}
+	pixman_region32_subtract(damage, damage, &unchanged);
+    }
+    pixman_region32_fini(&unchanged);
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_TILES_H_
+#define GLUE_TILES_H_
+
+#include <stdint.h>
+#include <pixman.h>
+#include "glib.h"
+
+#define GLUE_TILE_SIZE 64
+
+/* Hash of the content of each GLUE_TILE_SIZE square of an image */
+typedef struct {
+    gconstpointer data;
+    int           width, height, stride;
+    int           columns, rows;
+    guint64       *hashes;
+    /* FALSE for the tiles that have not been hashed yet */
+    gboolean      *valid;
+} GlueTileHashes;
+
+typedef struct {
+    guint64 tiles_hashed;
+    guint64 tiles_suppressed;
+    guint64 bytes_suppressed;
+} GlueTileCounters;
+
+void glue_tiles_init(GlueTileHashes *tiles);
+void glue_tiles_clear(GlueTileHashes *tiles);
+
+/* Forgets all the hashes, so that the next damage is not filtered */
+void glue_tiles_reset(GlueTileHashes *tiles);
+
+/* Hashes the damaged tiles of an image and removes from the damage those
+ * whose content is the same as when they were last hashed. The hashes
+ * are reset if the image is not the one of the previous call. Bytes are
+ * counted as 32 bits per pixel, as they are exported. */
+void glue_tiles_filter(GlueTileHashes *tiles, pixman_region32_t *damage,
+		       gconstpointer data, int width, int height, int stride,
+		       int bytes_per_pixel, GlueTileCounters *counters);
+
+#endif /* GLUE_TILES_H_ */
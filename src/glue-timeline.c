@@ -0,0 +1,134 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "spice-client.h"
+#include <spice-gtk/spice-util.h>
+
+#include "glue-timeline.h"
+
+static const char *step_names[GLUE_CONNECT_STEPS] = {
+    "session setup", "main channel init", "first primary surface",
+    "first display mark", "first frame published"
+};
+
+static void reset_steps(MonoGlueConnectTimeline *steps, gint64 started)
+{
+    int i;
+
+    steps->started = started;
+    for (i = 0; i < GLUE_CONNECT_STEPS; i++)
+	steps->steps[i] = -1;
+    steps->n_channels = 0;
+}
+
+void glue_timeline_init(GlueTimeline *timeline)
+{
+    g_mutex_init(&timeline->lock);
+    timeline->start = 0;
+    reset_steps(&timeline->steps, 0);
+}
+
+void glue_timeline_clear(GlueTimeline *timeline)
+{
+    g_mutex_clear(&timeline->lock);
+}
+
+void glue_timeline_start(GlueTimeline *timeline)
+{
+    g_mutex_lock(&timeline->lock);
+    timeline->start = g_get_monotonic_time();
+    reset_steps(&timeline->steps, g_get_real_time());
+    g_mutex_unlock(&timeline->lock);
+}
+
+/* Called with the lock held */
+static gint64 elapsed(GlueTimeline *timeline)
+{
+    return g_get_monotonic_time() - timeline->start;
+}
+
+void glue_timeline_step(GlueTimeline *timeline, GlueConnectStep step)
+{
+    g_mutex_lock(&timeline->lock);
+    if (timeline->start != 0 && timeline->steps.steps[step] < 0) {
+	timeline->steps.steps[step] = elapsed(timeline);
+	SPICE_DEBUG("connect timeline: %s at %" G_GINT64_FORMAT " us",
+		    step_names[step], timeline->steps.steps[step]);
+    }
+    g_mutex_unlock(&timeline->lock);
+}
+
+/* Called with the lock held, NULL if there are too many channels */
+static MonoGlueChannelTimeline *find_channel(GlueTimeline *timeline,
+					     gint type, gint id)
+{
+    MonoGlueConnectTimeline *steps = &timeline->steps;
+    int i;
+
+    for (i = 0; i < steps->n_channels; i++) {
+	if (steps->channels[i].type == type && steps->channels[i].id == id)
+	    return &steps->channels[i];
+    }
+    return NULL;
+}
+
+void glue_timeline_channel_new(GlueTimeline *timeline, gint type, gint id)
+{
+    MonoGlueConnectTimeline *steps = &timeline->steps;
+    MonoGlueChannelTimeline *channel;
+
+    g_mutex_lock(&timeline->lock);
+    if (timeline->start != 0 && steps->n_channels < GLUE_TIMELINE_MAX_CHANNELS &&
+	find_channel(timeline, type, id) == NULL) {
+	channel = &steps->channels[steps->n_channels++];
+	channel->type = type;
+	channel->id = id;
+	channel->created = elapsed(timeline);
+	channel->opened = -1;
+	channel->error = 0;
+	SPICE_DEBUG("connect timeline: channel type %d #%d created at %" G_GINT64_FORMAT " us",
+		    type, id, channel->created);
+    }
+    g_mutex_unlock(&timeline->lock);
+}
+
+void glue_timeline_channel_event(GlueTimeline *timeline, gint type, gint id,
+				 gint event)
+{
+    MonoGlueChannelTimeline *channel;
+
+    g_mutex_lock(&timeline->lock);
+    channel = find_channel(timeline, type, id);
+    if (channel != NULL) {
+	if (event == SPICE_CHANNEL_OPENED && channel->opened < 0) {
+	    channel->opened = elapsed(timeline);
+	    SPICE_DEBUG("connect timeline: channel type %d #%d opened at %" G_GINT64_FORMAT " us",
+			type, id, channel->opened);
+	} else if (event >= SPICE_CHANNEL_ERROR_CONNECT && channel->error == 0) {
+	    channel->error = event;
+	}
+    }
+    g_mutex_unlock(&timeline->lock);
+}
+
+void glue_timeline_get(GlueTimeline *timeline, MonoGlueConnectTimeline *steps)
+{
+    g_mutex_lock(&timeline->lock);
+    *steps = timeline->steps;
+    g_mutex_unlock(&timeline->lock);
+}
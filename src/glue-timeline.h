@@ -0,0 +1,51 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GLUE_TIMELINE_H_
+#define GLUE_TIMELINE_H_
+
+#include "glib.h"
+#include "mono-glue-types.h"
+
+/*
+ * Steps of the last connection of a session, from SpiceGlibGlue_Connect()
+ * until the first frame reaches the host. Written from the main loop of
+ * the session and read by the host, so it has its own lock.
+ */
+typedef struct {
+    GMutex                  lock;
+    /* Monotonic time of the connection, 0 before the first one */
+    gint64                  start;
+    MonoGlueConnectTimeline steps;
+} GlueTimeline;
+
+void glue_timeline_init(GlueTimeline *timeline);
+void glue_timeline_clear(GlueTimeline *timeline);
+
+/* Forgets the previous connection and starts timing a new one */
+void glue_timeline_start(GlueTimeline *timeline);
+/* Records a step of GlueConnectStep, only the first time it happens */
+void glue_timeline_step(GlueTimeline *timeline, GlueConnectStep step);
+/* Channels, identified by their type (SPICE_CHANNEL_*) and id */
+void glue_timeline_channel_new(GlueTimeline *timeline, gint type, gint id);
+void glue_timeline_channel_event(GlueTimeline *timeline, gint type, gint id,
+				 gint event);
+
+void glue_timeline_get(GlueTimeline *timeline, MonoGlueConnectTimeline *steps);
+
+#endif /* GLUE_TIMELINE_H_ */
@@ -0,0 +1,145 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "glue-triple-buffer.h"
+
+/* Set in "ready" when it holds a frame the consumer has not seen yet */
+#define NEW_FRAME  0x4
+#define INDEX_MASK 0x3
+
+static gint exchange_ready(GlueTripleBuffer *tb, gint value)
+{
+    gint old;
+
+    do {
+	old = g_atomic_int_get(&tb->ready);
+    } while (!g_atomic_int_compare_and_exchange(&tb->ready, old, value));
+    return old;
+}
+
+void glue_triple_buffer_init(GlueTripleBuffer *tb)
+{
+    int i;
+
+    memset(tb, 0, sizeof(*tb));
+    for (i = 0; i < 3; i++) {
+	pixman_region32_init(&tb->buffers[i].pending);
+    }
+    tb->front = 0;
+    tb->back = 1;
+    tb->ready = 2;
+}
+
+void glue_triple_buffer_clear(GlueTripleBuffer *tb)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+	g_free(tb->buffers[i].pixels);
+	tb->buffers[i].pixels = NULL;
+	pixman_region32_fini(&tb->buffers[i].pending);
+    }
+}
+
+/* Sets the size of the next frames. It does not touch the buffers, the
+ * consumer may be reading one of them */
+void glue_triple_buffer_resize(GlueTripleBuffer *tb, int32_t width, int32_t height)
+{
+    if (tb->width == width && tb->height == height)
+	return;
+
+    tb->width = width;
+    tb->height = height;
+    tb->generation++;
+}
+
+/* The back buffer belongs to the producer, so it can be reallocated here */
+GlueFrameBuffer *glue_triple_buffer_get_back(GlueTripleBuffer *tb)
+{
+    GlueFrameBuffer *fb = &tb->buffers[tb->back];
+
+    if (fb->generation != tb->generation || fb->pixels == NULL) {
+	if (fb->width != tb->width || fb->height != tb->height || fb->pixels == NULL) {
+	    g_free(fb->pixels);
+	    fb->pixels = g_new0(uint32_t, (gsize)tb->width * tb->height);
+	    fb->width = tb->width;
+	    fb->height = tb->height;
+	}
+	fb->sequence = 0;
+	fb->generation = tb->generation;
+	/* Damage of other sizes does not apply, copy it whole */
+	pixman_region32_reset(&fb->pending,
+			      &(pixman_box32_t){ 0, 0, tb->width, tb->height });
+    }
+    return fb;
+}
+
+/* Makes the back buffer the latest frame, and takes the previous one as the
+ * new back buffer. The damage of this frame is still pending in the
+ * other two buffers.
+ * Returns TRUE if the previous frame was replaced before the consumer took it. */
+gboolean glue_triple_buffer_publish(GlueTripleBuffer *tb, pixman_region32_t *damage,
+				    uint32_t sequence)
+{
+    gint old;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+	if (i != tb->back) {
+	    pixman_region32_union(&tb->buffers[i].pending,
+				  &tb->buffers[i].pending, damage);
+	}
+    }
+    tb->buffers[tb->back].sequence = sequence;
+    /* The swap is a full barrier: the consumer sees the pixels, size and
+     * sequence of the buffer written before it */
+    old = exchange_ready(tb, tb->back | NEW_FRAME);
+    tb->back = old & INDEX_MASK;
+    return (old & NEW_FRAME) != 0;
+}
+
+/* Takes the latest published frame, without waiting for the producer.
+ * Returns 1 if it is a new frame, 0 if it is the same frame as the last
+ * call, and -1 if no frame has been published yet.
+ * Unless -1 is returned, *front stays valid until glue_triple_buffer_release(). */
+int glue_triple_buffer_acquire(GlueTripleBuffer *tb, GlueFrameBuffer **front)
+{
+    int ret = 0;
+
+    if (g_atomic_int_get(&tb->ready) & NEW_FRAME) {
+	tb->front = exchange_ready(tb, tb->front) & INDEX_MASK;
+	ret = 1;
+    }
+    if (tb->buffers[tb->front].pixels == NULL)
+	return -1;
+
+    *front = &tb->buffers[tb->front];
+    return ret;
+}
+
+gboolean glue_triple_buffer_has_new_frame(GlueTripleBuffer *tb)
+{
+    return (g_atomic_int_get(&tb->ready) & NEW_FRAME) != 0;
+}
+
+/* The front buffer stays the consumer's until the next acquire, so there is
+ * nothing to give back; it ends the access to *front for the API */
+void glue_triple_buffer_release(GlueTripleBuffer *tb)
+{
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLUE_TRIPLE_BUFFER_H_
+#define GLUE_TRIPLE_BUFFER_H_
+
+#include <stdint.h>
+#include <pixman.h>
+#include "glib.h"
+
+/* A frame buffer owned by the glue */
+typedef struct {
+    uint32_t          *pixels;
+    /* Size of pixels, which may lag behind the size of the triple buffer */
+    int32_t           width, height;
+    /* Number of the frame stored in pixels */
+    uint32_t          sequence;
+    /* Damage published since this buffer was last written. Only the
+     * producer uses it, whoever owns the buffer */
+    pixman_region32_t pending;
+    /* GlueTripleBuffer.generation the buffer was last filled for */
+    guint             generation;
+} GlueFrameBuffer;
+
+/*
+ * Three frame buffers shared by a single producer (the GLib main loop) and
+ * a single consumer (the host render thread). The producer always owns the
+ * back buffer and the consumer the front buffer; the latest complete frame
+ * is exchanged through the "ready" index with an atomic swap, so neither
+ * side waits for the other, and no lock is taken.
+ * Resizing does not wait either: each buffer has its own size, and it is
+ * only reallocated while it is the back buffer, so the consumer keeps
+ * reading its frame at the old size until it takes a new one.
+ */
+typedef struct {
+    GlueFrameBuffer   buffers[3];
+    /* Size of the next frames, and how many times it has changed */
+    int32_t           width, height;
+    guint             generation;
+    gint              back;
+    volatile gint     ready;
+    gint              front;
+} GlueTripleBuffer;
+
+void glue_triple_buffer_init(GlueTripleBuffer *tb);
+/* Frees the buffers, no side may be using them */
+void glue_triple_buffer_clear(GlueTripleBuffer *tb);
+
+/* Producer side. Buffers of another size are reallocated when they
+ * become the back buffer */
+void glue_triple_buffer_resize(GlueTripleBuffer *tb, int32_t width, int32_t height);
+GlueFrameBuffer *glue_triple_buffer_get_back(GlueTripleBuffer *tb);
+gboolean glue_triple_buffer_publish(GlueTripleBuffer *tb, pixman_region32_t *damage,
+				    uint32_t sequence);
+
+/* Consumer side */
+int glue_triple_buffer_acquire(GlueTripleBuffer *tb, GlueFrameBuffer **front);
+/* TRUE if a frame has been published since the last acquire */
+gboolean glue_triple_buffer_has_new_frame(GlueTripleBuffer *tb);
+void glue_triple_buffer_release(GlueTripleBuffer *tb);
+
+#endif /* GLUE_TRIPLE_BUFFER_H_ */
@@ -26,6 +26,34 @@ typedef struct {
     int16_t buttonState;
 } GlueMotionEvent;
 
+/* Types of GlueInputEvent */
+typedef enum {
+    GLUE_INPUT_EVENT_MOTION = 0,
+    GLUE_INPUT_EVENT_BUTTON = 1,
+    GLUE_INPUT_EVENT_KEY = 2,
+    GLUE_INPUT_EVENT_SCROLL = 3,
+} GlueInputEventType;
+
+/* One event of SpiceGlibGlueInputEvents(), with the arguments of the
+ * single event call of its type */
+typedef struct {
+    /* GlueInputEventType */
+    int32_t type;
+    /* Motion and button events */
+    int32_t x;
+    int32_t y;
+    /* Key events */
+    int32_t keycode;
+    /* Button events */
+    int16_t buttonId;
+    /* Motion, button and scroll events */
+    int16_t buttonState;
+    /* Button, key and scroll events */
+    int16_t isDown;
+    /* OUT: what the single event call would have returned, negative on error */
+    int16_t result;
+} GlueInputEvent;
+
 typedef struct {
     uint32_t width;
     uint32_t height;
@@ -39,4 +67,122 @@ typedef struct {
     uint32_t y;
 } MonoGluePoint;
 
+/* Consistent snapshot of the guest cursor, see SpiceGlibGlueGetCursorState() */
+typedef struct {
+    /* Position in server mouse mode, -1 if unknown */
+    int32_t  x;
+    int32_t  y;
+    /* 0 while the guest hides the cursor */
+    int32_t  visible;
+    /* SPICE_MOUSE_MODE_SERVER or SPICE_MOUSE_MODE_CLIENT, 0 before connecting */
+    int32_t  mouse_mode;
+    /* Same id as SpiceGlibGlueGetCursor(), 0 if there is no cursor */
+    uint32_t cursor_id;
+} MonoGlueCursorState;
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+} MonoGlueRect;
+
+/* Percentiles of a histogram of times, in microseconds */
+typedef struct {
+    uint32_t count;
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+} MonoGluePercentiles;
+
+typedef struct {
+    /* Time since the statistics were reset */
+    uint64_t elapsed_usecs;
+    /* display-invalidate signals received */
+    uint64_t invalidations;
+    /* Frames published to the host */
+    uint64_t frames_copied;
+    /* Frames replaced by a newer one before the host took them */
+    uint64_t frames_skipped;
+    uint64_t pixels_copied;
+    uint64_t pixels_per_second;
+    /* Tile hashing (SpiceGlibGlueSetTileHashing()): tiles checked, tiles
+     * dropped from the damage because they had not changed, and their
+     * size in the exported frame */
+    uint64_t tiles_hashed;
+    uint64_t tiles_suppressed;
+    uint64_t bytes_suppressed;
+    /* Conversion of the damaged area of a frame */
+    MonoGluePercentiles copy_time;
+    /* Wait for the display lock before copying a frame */
+    MonoGluePercentiles lock_wait;
+    /* From the first invalidation of a frame until the host takes it */
+    MonoGluePercentiles pickup_latency;
+} GlueDisplayStats;
+
+typedef struct {
+    /* Time since the statistics were reset */
+    uint64_t elapsed_usecs;
+    /* Motion events received from the host, and motion messages sent to
+     * the guest; fewer are sent when they are coalesced
+     * (SpiceGlibGlueSetMotionRate()) */
+    uint64_t motion_received;
+    uint64_t motion_sent;
+    /* Input tracing (SpiceGlibGlueSetInputTracing()): from the moment a
+     * motion or key event enters the glue until it is sent to the guest,
+     * until the first damage near the pointer (anywhere for keys), and
+     * until the frame with that damage is published to the host */
+    MonoGluePercentiles input_to_send;
+    MonoGluePercentiles input_to_damage;
+    MonoGluePercentiles input_to_frame;
+    /* Traced events with no damage after GLUE_INPUT_TRACE_TIMEOUT */
+    uint64_t traces_expired;
+    /* Events lost because the input queue was full
+     * (SpiceGlibGlueSetQueuedInput()) */
+    uint64_t input_dropped;
+} GlueInputStats;
+
+/* Steps of a connection, indexes of MonoGlueConnectTimeline.steps */
+typedef enum {
+    /* The spice session has been created and configured */
+    GLUE_CONNECT_SESSION_SETUP = 0,
+    /* The main channel has received the init message from the server */
+    GLUE_CONNECT_MAIN_INIT = 1,
+    /* First display-primary-create of any display channel */
+    GLUE_CONNECT_PRIMARY_CREATE = 2,
+    /* First display-mark, the guest has drawn its primary surface */
+    GLUE_CONNECT_DISPLAY_MARK = 3,
+    /* First frame published to the host */
+    GLUE_CONNECT_FIRST_FRAME = 4,
+    GLUE_CONNECT_STEPS
+} GlueConnectStep;
+
+#define GLUE_TIMELINE_MAX_CHANNELS 16
+
+/* Times are in microseconds since the connection started, -1 if not reached */
+typedef struct {
+    /* SPICE_CHANNEL_MAIN, SPICE_CHANNEL_DISPLAY... and channel id */
+    int32_t type;
+    int32_t id;
+    /* Created by the session, and connected (TCP, TLS and link) */
+    int64_t created;
+    int64_t opened;
+    /* First error event of the channel (SPICE_CHANNEL_ERROR_*), 0 if none */
+    int32_t error;
+    int32_t reserved;
+} MonoGlueChannelTimeline;
+
+/* Timeline of the last connection, see SpiceGlibGlueGetConnectTimeline() */
+typedef struct {
+    /* When the connection started, in microseconds since the Epoch; 0 if
+     * there has been none */
+    int64_t started;
+    /* Time of each GlueConnectStep */
+    int64_t steps[GLUE_CONNECT_STEPS];
+    /* Channels in order of creation, up to GLUE_TIMELINE_MAX_CHANNELS */
+    int32_t n_channels;
+    int32_t reserved;
+    MonoGlueChannelTimeline channels[GLUE_TIMELINE_MAX_CHANNELS];
+} MonoGlueConnectTimeline;
+
 #endif /* MONO_GLUE_TYPES_H_ */
@@ -0,0 +1,213 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cost of copying the damage of a frame as the rectangles of its region,
+ * like copy_display_to_glue() does, against copying its bounding box.
+ * The damage of each trace is accumulated as invalidate() does, with the
+ * region coalesced into its extents beyond GLUE_MAX_DIRTY_RECTS.
+ *
+ * Usage: bench-damage [seconds per measure]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pixman.h>
+
+#include "glue-service.h"
+#include "glue-pixels.h"
+
+#define MAX_UPDATES 64
+
+typedef struct {
+    const char *name;
+    int        n_updates;
+    /* x, y, width, height */
+    int        updates[MAX_UPDATES][4];
+} Trace;
+
+typedef struct {
+    uint32_t *dst;
+    uint32_t *src;
+    int      width, height;
+} Surface;
+
+static void copy_box(Surface *surface, const pixman_box32_t *box)
+{
+    gint64 offset = (gint64)box->y1 * surface->width + box->x1;
+    int y;
+
+    for (y = box->y1; y < box->y2; y++) {
+	glue_argb_to_abgr_row(surface->dst + offset, surface->src + offset,
+			      box->x2 - box->x1);
+	offset += surface->width;
+    }
+}
+
+/* Accumulates the damage of a frame like invalidate() */
+static void build_region(const Trace *trace, int width, int height,
+			 pixman_region32_t *region)
+{
+    int i;
+
+    pixman_region32_init(region);
+    for (i = 0; i < trace->n_updates; i++) {
+	const int *u = trace->updates[i];
+
+	pixman_region32_union_rect(region, region, u[0], u[1], u[2], u[3]);
+	pixman_region32_intersect_rect(region, region, 0, 0, width, height);
+	if (pixman_region32_n_rects(region) > GLUE_MAX_DIRTY_RECTS) {
+	    pixman_box32_t extents = *pixman_region32_extents(region);
+	    pixman_region32_reset(region, &extents);
+	}
+    }
+}
+
+/* Copies the boxes for about seconds. Returns the microseconds per frame */
+static double measure(Surface *surface, const pixman_box32_t *boxes, int n_boxes,
+		      double seconds)
+{
+    gint64 start = g_get_monotonic_time(), elapsed;
+    int frames = 0, i;
+
+    do {
+	for (i = 0; i < n_boxes; i++)
+	    copy_box(surface, &boxes[i]);
+	frames++;
+	elapsed = g_get_monotonic_time() - start;
+    } while (elapsed < seconds * G_USEC_PER_SEC);
+
+    return (double)elapsed / frames;
+}
+
+static gint64 count_pixels(const pixman_box32_t *boxes, int n_boxes)
+{
+    gint64 n_pixels = 0;
+    int i;
+
+    for (i = 0; i < n_boxes; i++)
+	n_pixels += (gint64)(boxes[i].x2 - boxes[i].x1) * (boxes[i].y2 - boxes[i].y1);
+    return n_pixels;
+}
+
+/* Two distant small updates: a blinking caret near the top left corner
+ * and a clock in the bottom right one */
+static void make_caret_and_clock(Trace *trace, int width, int height)
+{
+    static const int caret[4] = { 48, 36, 2, 18 };
+    int clock[4] = { 0, 0, 72, 20 };
+
+    clock[0] = width - 96;
+    clock[1] = height - 28;
+    trace->name = "caret+clock";
+    trace->n_updates = 2;
+    memcpy(trace->updates[0], caret, sizeof(caret));
+    memcpy(trace->updates[1], clock, sizeof(clock));
+}
+
+/* Same, with the pointer moving over the middle of the screen in server mode */
+static void make_caret_clock_pointer(Trace *trace, int width, int height)
+{
+    int i;
+
+    make_caret_and_clock(trace, width, height);
+    trace->name = "+pointer";
+    for (i = 0; i < 4; i++) {
+	int *u = trace->updates[trace->n_updates++];
+
+	u[0] = width / 2 + i * 6;
+	u[1] = height / 2 + i * 3;
+	u[2] = 32;
+	u[3] = 32;
+    }
+}
+
+/* Typing in two windows side by side: many small updates, more than
+ * GLUE_MAX_DIRTY_RECTS, that end up coalesced */
+static void make_scattered(Trace *trace, int width, int height)
+{
+    int i;
+
+    trace->name = "scattered";
+    trace->n_updates = 48;
+    for (i = 0; i < trace->n_updates; i++) {
+	int *u = trace->updates[i];
+
+	u[0] = (i % 2 ? width / 2 : 0) + 40 + (i / 2) * 9;
+	u[1] = 200 + (i / 2) % 6 * 24;
+	u[2] = 8;
+	u[3] = 16;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+	const char *name;
+	int width, height;
+    } resolutions[] = {
+	{ "1080p", 1920, 1080 },
+	{ "4K",    3840, 2160 },
+    };
+    static void (*const make_trace[])(Trace *, int, int) = {
+	make_caret_and_clock, make_caret_clock_pointer, make_scattered,
+    };
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    gsize n_pixels = 3840 * 2160, k;
+    Surface surface;
+    Trace trace;
+    int i, j;
+
+    glue_pixels_init();
+    surface.src = g_new(uint32_t, n_pixels);
+    /* Cleared, so that the first copy does not pay for the page faults */
+    surface.dst = g_new0(uint32_t, n_pixels);
+    for (k = 0; k < n_pixels; k++)
+	surface.src[k] = (uint32_t)(k * 2654435761u);
+
+    printf("kernel: %s\n", glue_pixels_kernel_name());
+    for (i = 0; i < G_N_ELEMENTS(resolutions); i++) {
+	surface.width = resolutions[i].width;
+	surface.height = resolutions[i].height;
+	for (j = 0; j < G_N_ELEMENTS(make_trace); j++) {
+	    pixman_region32_t region;
+	    pixman_box32_t *boxes, extents;
+	    int n_boxes;
+	    double region_us, extents_us;
+
+	    make_trace[j](&trace, surface.width, surface.height);
+	    build_region(&trace, surface.width, surface.height, &region);
+	    boxes = pixman_region32_rectangles(&region, &n_boxes);
+	    extents = *pixman_region32_extents(&region);
+
+	    region_us = measure(&surface, boxes, n_boxes, seconds);
+	    extents_us = measure(&surface, &extents, 1, seconds);
+	    printf("%-6s %-12s region %2d rects %8" G_GINT64_FORMAT " pix %9.1f us, "
+		   "extents %8" G_GINT64_FORMAT " pix %9.1f us  x%.1f\n",
+		   resolutions[i].name, trace.name,
+		   n_boxes, count_pixels(boxes, n_boxes), region_us,
+		   count_pixels(&extents, 1), extents_us, extents_us / region_us);
+	    pixman_region32_fini(&region);
+	}
+    }
+
+    g_free(surface.src);
+    g_free(surface.dst);
+    return 0;
+}
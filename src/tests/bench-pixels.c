@@ -0,0 +1,106 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Throughput of the row conversion kernels on whole frames of common
+ * resolutions, for every kernel set the CPU supports.
+ *
+ * Usage: bench-pixels [seconds per measure]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+
+#include "glue-pixels.h"
+
+#define MAX_KERNELS 8
+
+static const struct {
+    const char *name;
+    int width, height;
+} resolutions[] = {
+    { "1080p", 1920, 1080 },
+    { "1440p", 2560, 1440 },
+    { "4K",    3840, 2160 },
+};
+
+/* Converts whole frames with convert_row for about seconds.
+ * Returns the frames per second */
+static double measure(GlueConvertRowFunc convert_row, uint32_t *dst, const void *src,
+		      int width, int height, int src_bpp, double seconds)
+{
+    gint64 start = g_get_monotonic_time(), elapsed;
+    int frames = 0, i;
+
+    do {
+	for (i = 0; i < height; i++) {
+	    convert_row(dst + (gint64)i * width,
+			(const guint8 *)src + (gint64)i * width * src_bpp, width);
+	}
+	frames++;
+	elapsed = g_get_monotonic_time() - start;
+    } while (elapsed < seconds * G_USEC_PER_SEC);
+
+    return frames * (double)G_USEC_PER_SEC / elapsed;
+}
+
+static void report(const char *kernel, const char *format, const char *resolution,
+		   int width, int height, int src_bpp, double fps)
+{
+    double pixels = (double)width * height * fps;
+
+    /* Bytes read from the surface plus bytes written to the glue buffer */
+    printf("%-8s %-7s %-6s %8.1f fps %8.1f Mpix/s %7.2f GB/s\n",
+	   kernel, format, resolution, fps, pixels / 1e6,
+	   pixels * (src_bpp + 4) / 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+    const GluePixelKernels *kernels[MAX_KERNELS];
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    int n_kernels, i, j;
+    gsize max_pixels = 0, k;
+    uint32_t *src, *dst;
+
+    for (j = 0; j < G_N_ELEMENTS(resolutions); j++)
+	max_pixels = MAX(max_pixels, (gsize)resolutions[j].width * resolutions[j].height);
+    src = g_new(uint32_t, max_pixels);
+    dst = g_new(uint32_t, max_pixels);
+    /* Not a constant, so that no kernel can take a shortcut */
+    for (k = 0; k < max_pixels; k++)
+	src[k] = (uint32_t)(k * 2654435761u);
+
+    n_kernels = glue_pixels_get_kernels(kernels, MAX_KERNELS);
+    for (i = 0; i < n_kernels; i++) {
+	for (j = 0; j < G_N_ELEMENTS(resolutions); j++) {
+	    int w = resolutions[j].width, h = resolutions[j].height;
+
+	    report(kernels[i]->name, "xRGB", resolutions[j].name, w, h, 4,
+		   measure(kernels[i]->argb_to_abgr_row, dst, src, w, h, 4, seconds));
+	    report(kernels[i]->name, "RGB565", resolutions[j].name, w, h, 2,
+		   measure(kernels[i]->rgb565_to_abgr_row, dst, src, w, h, 2, seconds));
+	    report(kernels[i]->name, "RGB555", resolutions[j].name, w, h, 2,
+		   measure(kernels[i]->rgb555_to_abgr_row, dst, src, w, h, 2, seconds));
+	}
+    }
+
+    g_free(src);
+    g_free(dst);
+    return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Scaling of the parallel stripe conversion: whole 1080p and 4K frames
+ * converted with the selected kernel by 1 to N threads.
+ *
+ * Usage: bench-stripes [max threads] [seconds per measure]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+
+#include "glue-pixels.h"
+#include "glue-stripes.h"
+
+typedef struct {
+    uint32_t *dst;
+    uint32_t *src;
+    int      width;
+} Frame;
+
+static void convert_stripe(gpointer data, int y1, int y2)
+{
+    Frame *frame = data;
+    gint64 offset = (gint64)y1 * frame->width;
+
+    glue_argb_to_abgr_row(frame->dst + offset, frame->src + offset,
+			  (y2 - y1) * frame->width);
+}
+
+/* Returns the frames per second */
+static double measure(Frame *frame, int height, double seconds)
+{
+    gint64 start = g_get_monotonic_time(), elapsed;
+    int frames = 0;
+
+    do {
+	glue_stripes_run(convert_stripe, frame, 0, height,
+			 (gint64)frame->width * height);
+	frames++;
+	elapsed = g_get_monotonic_time() - start;
+    } while (elapsed < seconds * G_USEC_PER_SEC);
+
+    return frames * (double)G_USEC_PER_SEC / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+	const char *name;
+	int width, height;
+    } resolutions[] = {
+	{ "1080p", 1920, 1080 },
+	{ "4K",    3840, 2160 },
+    };
+    int max_threads = argc > 1 ? atoi(argv[1]) : g_get_num_processors();
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+    gsize n_pixels = 3840 * 2160, k;
+    Frame frame;
+    int i, n;
+
+    glue_pixels_init();
+    frame.src = g_new(uint32_t, n_pixels);
+    frame.dst = g_new(uint32_t, n_pixels);
+    for (k = 0; k < n_pixels; k++)
+	frame.src[k] = (uint32_t)(k * 2654435761u);
+
+    printf("kernel: %s\n", glue_pixels_kernel_name());
+    for (i = 0; i < G_N_ELEMENTS(resolutions); i++) {
+	double base = 0;
+
+	frame.width = resolutions[i].width;
+	for (n = 1; n <= max_threads; n++) {
+	    double fps;
+
+	    glue_stripes_set_threads(n);
+	    /* The first run creates the pool with the new number of threads */
+	    glue_stripes_run(convert_stripe, &frame, 0, resolutions[i].height,
+			     (gint64)frame.width * resolutions[i].height);
+	    fps = measure(&frame, resolutions[i].height, seconds);
+	    if (n == 1)
+		base = fps;
+	    printf("%-6s %2d threads %8.1f fps %7.2f GB/s  x%.2f\n",
+		   resolutions[i].name, n, fps,
+		   fps * frame.width * resolutions[i].height * 8 / 1e9, fps / base);
+	}
+    }
+
+    g_free(frame.src);
+    g_free(frame.dst);
+    return 0;
+}
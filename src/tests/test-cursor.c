@@ -0,0 +1,269 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cursor cache and visibility of glue-cursor.c. The allocator is wrapped
+ * with counters, to prove that hiding, showing and moving the cursor, or
+ * switching to a cached shape, never allocate memory.
+ */
+
+#include <stdlib.h>
+#include <glib.h>
+
+#include "glue-cursor.h"
+
+#define N_EVENTS 1000
+
+#ifdef __GLIBC__
+/* Every allocation of the process goes through these while the test runs,
+ * including the ones of GLib and the glue */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static volatile gint counting;
+static volatile gint allocations;
+
+void *malloc(size_t size)
+{
+    if (g_atomic_int_get(&counting))
+	g_atomic_int_inc(&allocations);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    if (g_atomic_int_get(&counting))
+	g_atomic_int_inc(&allocations);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (g_atomic_int_get(&counting))
+	g_atomic_int_inc(&allocations);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static void start_counting(void)
+{
+    g_atomic_int_set(&allocations, 0);
+    g_atomic_int_set(&counting, TRUE);
+}
+
+/* Returns the allocations made since start_counting() */
+static gint stop_counting(void)
+{
+    g_atomic_int_set(&counting, FALSE);
+    return g_atomic_int_get(&allocations);
+}
+#endif
+
+/* A 4x4 shape, different for each seed */
+static void make_shape(uint32_t *rgba, uint32_t seed)
+{
+    int i;
+
+    for (i = 0; i < 16; i++)
+	rgba[i] = seed * 16 + i;
+}
+
+static void test_cache_ids(void)
+{
+    GlueCursorCache cache;
+    GlueCursor *arrow, *ibeam, *again;
+    uint32_t rgba[16];
+
+    glue_cursor_cache_init(&cache);
+    make_shape(rgba, 1);
+    arrow = glue_cursor_cache_lookup(&cache, 4, 4, 0, 0, rgba);
+    make_shape(rgba, 2);
+    ibeam = glue_cursor_cache_lookup(&cache, 4, 4, 2, 2, rgba);
+    g_assert_cmpuint(arrow->id, >, GLUE_CURSOR_BLANK_ID);
+    g_assert_cmpuint(ibeam->id, !=, arrow->id);
+
+    /* Same pixels, same shape and id */
+    make_shape(rgba, 1);
+    again = glue_cursor_cache_lookup(&cache, 4, 4, 0, 0, rgba);
+    g_assert_true(again == arrow);
+    /* The hot spot is part of the shape */
+    glue_cursor_unref(again);
+    again = glue_cursor_cache_lookup(&cache, 4, 4, 1, 1, rgba);
+    g_assert_true(again != arrow);
+
+    glue_cursor_unref(again);
+    glue_cursor_unref(ibeam);
+    glue_cursor_cache_clear(&cache);
+    /* Still referenced, it survives the cache */
+    g_assert_cmpint(arrow->ref_count, ==, 1);
+    glue_cursor_unref(arrow);
+}
+
+/* The least recently used shape is evicted, and ids are never reused */
+static void test_cache_eviction(void)
+{
+    GlueCursorCache cache;
+    GlueCursor *first, *c;
+    uint32_t rgba[16], first_id, max_id = 0;
+    int i;
+
+    glue_cursor_cache_init(&cache);
+    make_shape(rgba, 0);
+    first = glue_cursor_cache_lookup(&cache, 4, 4, 0, 0, rgba);
+    first_id = first->id;
+    glue_cursor_unref(first);
+
+    for (i = 1; i <= GLUE_CURSOR_CACHE_SIZE; i++) {
+	make_shape(rgba, i);
+	c = glue_cursor_cache_lookup(&cache, 4, 4, 0, 0, rgba);
+	max_id = MAX(max_id, c->id);
+	glue_cursor_unref(c);
+    }
+
+    make_shape(rgba, 0);
+    c = glue_cursor_cache_lookup(&cache, 4, 4, 0, 0, rgba);
+    g_assert_cmpuint(c->id, !=, first_id);
+    g_assert_cmpuint(c->id, >, max_id);
+    glue_cursor_unref(c);
+    glue_cursor_cache_clear(&cache);
+}
+
+/* A new display, after a reconnection, does not repeat the ids of the old one */
+static void test_cache_ids_across_caches(void)
+{
+    GlueCursorCache old_cache, new_cache;
+    GlueCursor *old_arrow, *new_arrow;
+    uint32_t rgba[16];
+
+    glue_cursor_cache_init(&old_cache);
+    glue_cursor_cache_init(&new_cache);
+    make_shape(rgba, 1);
+    old_arrow = glue_cursor_cache_lookup(&old_cache, 4, 4, 0, 0, rgba);
+    glue_cursor_cache_clear(&old_cache);
+    make_shape(rgba, 2);
+    new_arrow = glue_cursor_cache_lookup(&new_cache, 4, 4, 0, 0, rgba);
+    g_assert_cmpuint(new_arrow->id, >, old_arrow->id);
+
+    glue_cursor_unref(old_arrow);
+    glue_cursor_unref(new_arrow);
+    glue_cursor_cache_clear(&new_cache);
+}
+
+static void test_view_visibility(void)
+{
+    GlueCursorCache cache;
+    GlueCursorView view;
+    uint32_t rgba[16];
+
+    glue_cursor_cache_init(&cache);
+    glue_cursor_view_init(&view);
+    g_assert_null(glue_cursor_view_get_shown(&view));
+    g_assert_cmpuint(view.id, ==, 0);
+
+    make_shape(rgba, 1);
+    glue_cursor_view_set_shape(&view, glue_cursor_cache_lookup(&cache, 4, 4, 0, 0, rgba));
+    g_assert_true(glue_cursor_view_get_shown(&view) == view.shape);
+    g_assert_cmpuint(view.id, ==, view.shape->id);
+
+    glue_cursor_view_set_visible(&view, FALSE);
+    g_assert_true(glue_cursor_view_get_shown(&view) == glue_cursor_blank());
+    g_assert_cmpuint(view.id, ==, GLUE_CURSOR_BLANK_ID);
+    /* A new shape while hidden stays hidden */
+    make_shape(rgba, 2);
+    glue_cursor_view_set_shape(&view, glue_cursor_cache_lookup(&cache, 4, 4, 0, 0, rgba));
+    g_assert_cmpuint(view.id, ==, GLUE_CURSOR_BLANK_ID);
+
+    glue_cursor_view_set_visible(&view, TRUE);
+    g_assert_cmpuint(view.id, ==, view.shape->id);
+
+    glue_cursor_view_set_shape(&view, NULL);
+    g_assert_cmpuint(view.id, ==, 0);
+    glue_cursor_cache_clear(&cache);
+}
+
+#ifdef __GLIBC__
+/* What cursor_hide(), cursor_move() and cursor_set() of a cached shape do
+ * in the widget, with the cursor_lock held */
+static void test_no_allocations(void)
+{
+    GlueCursorCache cache;
+    GlueCursorView view;
+    GlueCursorState state;
+    MonoGlueCursorState value, read;
+    uint32_t arrow[16], ibeam[16];
+    int i;
+
+    glue_cursor_cache_init(&cache);
+    glue_cursor_view_init(&view);
+    glue_cursor_state_init(&state);
+    make_shape(arrow, 1);
+    make_shape(ibeam, 2);
+    /* The first lookups copy the shapes */
+    glue_cursor_view_set_shape(&view, glue_cursor_cache_lookup(&cache, 4, 4, 0, 0, ibeam));
+    glue_cursor_view_set_shape(&view, glue_cursor_cache_lookup(&cache, 4, 4, 0, 0, arrow));
+
+    start_counting();
+    for (i = 0; i < N_EVENTS; i++) {
+	/* Switch between cached shapes */
+	glue_cursor_view_set_shape(&view, glue_cursor_cache_lookup(&cache, 4, 4, 0, 0,
+								   i % 2 ? arrow : ibeam));
+	/* Hide and show */
+	glue_cursor_view_set_visible(&view, FALSE);
+	glue_cursor_view_set_visible(&view, TRUE);
+	/* Move */
+	value.x = i;
+	value.y = N_EVENTS - i;
+	value.visible = view.shape != NULL && view.visible;
+	value.mouse_mode = 1;
+	value.cursor_id = view.id;
+	glue_cursor_state_publish(&state, &value);
+	glue_cursor_state_read(&state, &read);
+    }
+    g_assert_cmpint(stop_counting(), ==, 0);
+    g_assert_cmpint(read.x, ==, N_EVENTS - 1);
+    g_assert_cmpuint(read.cursor_id, ==, view.id);
+
+    /* The counters do see allocations */
+    start_counting();
+    g_free(g_malloc(16));
+    g_assert_cmpint(stop_counting(), ==, 1);
+
+    glue_cursor_view_set_shape(&view, NULL);
+    glue_cursor_cache_clear(&cache);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/cursor/cache/ids", test_cache_ids);
+    g_test_add_func("/cursor/cache/eviction", test_cache_eviction);
+    g_test_add_func("/cursor/cache/ids-across-caches", test_cache_ids_across_caches);
+    g_test_add_func("/cursor/view/visibility", test_view_visibility);
+#ifdef __GLIBC__
+    g_test_add_func("/cursor/no-allocations", test_no_allocations);
+#endif
+
+    return g_test_run();
+}
@@ -0,0 +1,130 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Input ring of glue-input-ring.c: the main loop runs the events in the
+ * order they were pushed, a full ring drops the new ones, and a burst
+ * wakes the main loop up once.
+ */
+
+#include <glib.h>
+
+#include "glue-input-ring.h"
+
+/* Keycodes of the events run so far */
+static gint32 ran[2 * GLUE_INPUT_RING_SIZE];
+static int n_ran;
+
+static void record_input(const GlueQueuedInput *input, gpointer user_data)
+{
+    g_assert_cmpint(n_ran, <, G_N_ELEMENTS(ran));
+    ran[n_ran++] = input->event.keycode;
+}
+
+static gboolean push_key(gint32 keycode)
+{
+    GlueQueuedInput input = { { GLUE_INPUT_EVENT_KEY, 0, 0, keycode, 0, 0, 1, 0 },
+			      -1, -1, 0 };
+
+    return glue_input_ring_push(&input);
+}
+
+static void run_main_loop(void)
+{
+    while (g_main_context_iteration(NULL, FALSE))
+	;
+}
+
+static void test_ring_order(void)
+{
+    guint wakeups = glue_input_ring_get_wakeups();
+    int i;
+
+    n_ran = 0;
+    for (i = 0; i < 100; i++)
+	g_assert_true(push_key(i));
+    g_assert_cmpint(n_ran, ==, 0);
+
+    run_main_loop();
+    g_assert_cmpint(n_ran, ==, 100);
+    for (i = 0; i < 100; i++)
+	g_assert_cmpint(ran[i], ==, i);
+    /* A single wakeup for the whole burst */
+    g_assert_cmpuint(glue_input_ring_get_wakeups(), ==, wakeups + 1);
+}
+
+static void test_ring_full(void)
+{
+    int i, dropped = 0;
+
+    n_ran = 0;
+    for (i = 0; i < GLUE_INPUT_RING_SIZE + 5; i++) {
+	if (!push_key(i))
+	    dropped++;
+    }
+    g_assert_cmpint(dropped, ==, 5);
+
+    run_main_loop();
+    g_assert_cmpint(n_ran, ==, GLUE_INPUT_RING_SIZE);
+    for (i = 0; i < n_ran; i++)
+	g_assert_cmpint(ran[i], ==, i);
+    /* Room again */
+    g_assert_true(push_key(0));
+    run_main_loop();
+}
+
+/* Each burst after a drain wakes the main loop up again, once */
+static void test_ring_wakeups(void)
+{
+    guint wakeups = glue_input_ring_get_wakeups();
+    int burst, i;
+
+    for (burst = 1; burst <= 3; burst++) {
+	for (i = 0; i < 10; i++)
+	    g_assert_true(push_key(i));
+	g_assert_cmpuint(glue_input_ring_get_wakeups(), ==, wakeups + burst);
+	run_main_loop();
+    }
+}
+
+/* What SpiceGlibGlueSetQueuedInput(0) waits for */
+static void test_ring_flush(void)
+{
+    n_ran = 0;
+    g_assert_true(push_key(7));
+    g_assert_true(push_key(8));
+    glue_input_ring_flush();
+    g_assert_cmpint(n_ran, ==, 2);
+    g_assert_cmpint(ran[0], ==, 7);
+    g_assert_cmpint(ran[1], ==, 8);
+    /* The wakeup is not needed anymore */
+    run_main_loop();
+    g_assert_cmpint(n_ran, ==, 2);
+}
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    glue_input_ring_init(record_input, NULL);
+
+    g_test_add_func("/input-ring/order", test_ring_order);
+    g_test_add_func("/input-ring/full", test_ring_full);
+    g_test_add_func("/input-ring/wakeups", test_ring_wakeups);
+    g_test_add_func("/input-ring/flush", test_ring_flush);
+
+    return g_test_run();
+}
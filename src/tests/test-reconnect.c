@@ -0,0 +1,221 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Reconnections against a local stand-in server. It accepts connections,
+ * reads the link message of each channel and closes it, so every
+ * connection fails right after linking its main channel. That is enough
+ * to check which SpiceSession each connection uses and what it keeps.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "glue-session.h"
+
+/* The host side of the glue, as declared by the host */
+GlueSession *SpiceGlibGlueSessionNew(void);
+int16_t SpiceGlibGlueSessionFree(GlueSession *session);
+int16_t SpiceGlibGlueSessionConnect(GlueSession *session, char* host,
+				    char* port, char* tls_port, char* ws_port,
+				    char* password,
+				    char* ca_file, char* cert_subj,
+				    int32_t enable_sound);
+int16_t SpiceGlibGlueSessionReconnect(GlueSession *session);
+int16_t SpiceGlibGlueSessionIsConnected(GlueSession *session);
+
+#define LINK_MAGIC        "REDQ"
+#define LINK_HEADER_SIZE  16
+#define MAIN_CHANNEL      1
+#define TIMEOUT           (10 * G_USEC_PER_SEC)
+
+#define TEST_CA "-----BEGIN CERTIFICATE-----\nstand-in\n-----END CERTIFICATE-----\n"
+
+#ifndef WIN32
+typedef struct {
+    int           fd;
+    int           port;
+    GThread       *thread;
+    volatile gint stop;
+    /* Main channels linked so far */
+    volatile gint main_links;
+} StandIn;
+
+static gboolean read_all(int fd, guint8 *buf, size_t size)
+{
+    while (size > 0) {
+	ssize_t n = read(fd, buf, size);
+
+	if (n <= 0)
+	    return FALSE;
+	buf += n;
+	size -= n;
+    }
+    return TRUE;
+}
+
+/* Reads the link header and message of a channel, then drops it */
+static void serve_channel(StandIn *server, int fd)
+{
+    guint8 header[LINK_HEADER_SIZE], mess[4096];
+    guint32 size;
+
+    if (!read_all(fd, header, sizeof(header)) ||
+	memcmp(header, LINK_MAGIC, 4) != 0)
+	return;
+    size = header[12] | header[13] << 8 | header[14] << 16 | (guint32)header[15] << 24;
+    if (size < 6 || size > sizeof(mess) || !read_all(fd, mess, size))
+	return;
+    /* After the connection id */
+    if (mess[4] == MAIN_CHANNEL)
+	g_atomic_int_inc(&server->main_links);
+}
+
+static gpointer run_server(gpointer data)
+{
+    StandIn *server = data;
+    struct pollfd pfd = { server->fd, POLLIN, 0 };
+
+    while (!g_atomic_int_get(&server->stop)) {
+	int fd;
+
+	if (poll(&pfd, 1, 100) <= 0)
+	    continue;
+	fd = accept(server->fd, NULL, NULL);
+	if (fd == -1)
+	    continue;
+	serve_channel(server, fd);
+	close(fd);
+    }
+    return NULL;
+}
+
+static void start_server(StandIn *server)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    memset(server, 0, sizeof(*server));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server->fd = socket(AF_INET, SOCK_STREAM, 0);
+    g_assert_cmpint(server->fd, !=, -1);
+    g_assert_cmpint(bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)), ==, 0);
+    g_assert_cmpint(listen(server->fd, 8), ==, 0);
+    g_assert_cmpint(getsockname(server->fd, (struct sockaddr *)&addr, &len), ==, 0);
+    server->port = ntohs(addr.sin_port);
+    server->thread = g_thread_new("stand-in", run_server, server);
+}
+
+static void stop_server(StandIn *server)
+{
+    g_atomic_int_set(&server->stop, TRUE);
+    g_thread_join(server->thread);
+    close(server->fd);
+}
+
+/* Runs the main loop until the server has linked n main channels and the
+ * session has given up its connection */
+static void wait_for_links(StandIn *server, GlueSession *session, gint n)
+{
+    gint64 deadline = g_get_monotonic_time() + TIMEOUT;
+
+    while (g_atomic_int_get(&server->main_links) < n ||
+	   SpiceGlibGlueSessionIsConnected(session)) {
+	g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+	if (!g_main_context_iteration(NULL, FALSE))
+	    g_usleep(1000);
+    }
+}
+
+static void test_reconnect_reuses_session(void)
+{
+    StandIn server;
+    GlueSession *session;
+    SpiceSession *first;
+    GByteArray *ca = NULL;
+    gchar *ca_file, port[16];
+    int fd;
+
+    start_server(&server);
+    snprintf(port, sizeof(port), "%d", server.port);
+    fd = g_file_open_tmp("test-reconnect-XXXXXX.pem", &ca_file, NULL);
+    g_assert_cmpint(fd, !=, -1);
+    g_assert_cmpint(write(fd, TEST_CA, strlen(TEST_CA)), ==, strlen(TEST_CA));
+    close(fd);
+
+    session = SpiceGlibGlueSessionNew();
+    g_assert_cmpint(SpiceGlibGlueSessionConnect(session, "127.0.0.1", port, "-1", "-1",
+						NULL, ca_file, NULL, 0), ==, 0);
+    wait_for_links(&server, session, 1);
+    first = session->spice_session;
+    g_assert_nonnull(first);
+    g_object_add_weak_pointer(G_OBJECT(first), (gpointer *)&first);
+
+    /* The CA is kept in memory, the file is not needed any more */
+    g_object_get(first, "ca", &ca, NULL);
+    g_assert_nonnull(ca);
+    g_assert_cmpuint(ca->len, ==, strlen(TEST_CA));
+    g_assert_true(memcmp(ca->data, TEST_CA, ca->len) == 0);
+    g_byte_array_unref(ca);
+    unlink(ca_file);
+
+    /* Same server, same session */
+    g_assert_cmpint(SpiceGlibGlueSessionReconnect(session), ==, 0);
+    wait_for_links(&server, session, 2);
+    g_assert_true(session->spice_session == first);
+
+    /* New arguments, new session */
+    g_assert_cmpint(SpiceGlibGlueSessionConnect(session, "127.0.0.1", port, "-1", "-1",
+						NULL, NULL, NULL, 0), ==, 0);
+    wait_for_links(&server, session, 3);
+    g_assert_null(first);
+    g_assert_nonnull(session->spice_session);
+
+    g_assert_cmpint(SpiceGlibGlueSessionFree(session), ==, 0);
+    g_free(ca_file);
+    stop_server(&server);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+#ifdef WIN32
+    /* The stand-in server uses POSIX sockets */
+    return 77;
+#else
+    /* It runs the real spice-glib connection code against a local socket,
+     * which not every build host allows, and takes a few seconds */
+    if (g_getenv("SPICEGLUE_TEST_RECONNECT") == NULL) {
+	g_printerr("skipped, set SPICEGLUE_TEST_RECONNECT=1 to run it\n");
+	return 77;
+    }
+    g_test_add_func("/reconnect/reuses-session", test_reconnect_reuses_session);
+    return g_test_run();
+#endif
+}
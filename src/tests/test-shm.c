@@ -0,0 +1,259 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Shared memory frames read by another process. The parent publishes
+ * frames whose pixels all hold their sequence number, while a forked
+ * reader follows the protocol of glue-shm.h and checks that it never
+ * accepts a torn frame, and that it finally gets the last one.
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+
+#include "glue-shm.h"
+
+#define WIDTH     64
+#define HEIGHT    48
+#define N_FRAMES  2000
+/* The reader gives up after this time */
+#define READER_TIMEOUT (10 * G_USEC_PER_SEC)
+
+#ifndef WIN32
+/* Returns the segment mapped read-only, as a renderer process would map it */
+static const GlueShmHeader *map_segment(GlueShm *shm)
+{
+    struct stat st;
+    void *base;
+    int fd = shm->fd;
+
+    /* A memfd is passed by descriptor, here inherited through fork() */
+    if (shm->name[0] != '\0')
+	fd = shm_open(shm->name, O_RDONLY, 0);
+    if (fd == -1 || fstat(fd, &st) == -1)
+	return NULL;
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    return base == MAP_FAILED ? NULL : base;
+}
+
+/* Takes the latest frame following the reader protocol.
+ * Returns its sequence, 0 if there is none or it has to be retried. */
+static uint32_t read_frame(const GlueShmHeader *h, uint32_t *pixels,
+			   uint32_t *width, uint32_t *height)
+{
+    const GlueShmFrameInfo *info;
+    const GlueShmSlot *slot;
+    MonoGlueRect rects[GLUE_MAX_DIRTY_RECTS];
+    uint32_t latest, seqlock, n_rects, i;
+
+    latest = g_atomic_int_get((gint *)&h->latest);
+    if (latest == 0)
+	return 0;
+    info = &h->frames[latest % GLUE_SHM_RING_SIZE];
+    if (g_atomic_int_get((gint *)&info->sequence) != latest)
+	return 0;
+    slot = &h->slots[info->slot];
+    seqlock = g_atomic_int_get((gint *)&slot->seqlock);
+    if (seqlock & 1)
+	return 0;
+
+    n_rects = MIN(info->n_rects, GLUE_MAX_DIRTY_RECTS);
+    memcpy(rects, info->rects, n_rects * sizeof(MonoGlueRect));
+    if (g_atomic_int_get((gint *)&info->sequence) != latest)
+	return 0;
+    for (i = 0; i < n_rects; i++) {
+	if (rects[i].x + rects[i].width > WIDTH || rects[i].y + rects[i].height > HEIGHT)
+	    return 0;
+    }
+
+    *width = slot->width;
+    *height = slot->height;
+    if (slot->sequence != latest || *width > WIDTH || *height > HEIGHT)
+	return 0;
+    memcpy(pixels, (const guint8 *)h + h->header_size + (gsize)info->slot * h->slot_size,
+	   *width * *height * sizeof(uint32_t));
+
+    if (g_atomic_int_get((gint *)&slot->seqlock) != seqlock)
+	return 0;
+    return latest;
+}
+
+/* Exit status: 0 on success, 1 on a torn frame, 2 on timeout */
+static int run_reader(GlueShm *shm)
+{
+    const GlueShmHeader *h = map_segment(shm);
+    uint32_t pixels[WIDTH * HEIGHT];
+    uint32_t sequence, previous = 0, width, height, i;
+    gint64 deadline = g_get_monotonic_time() + READER_TIMEOUT;
+
+    if (h == NULL || h->magic != GLUE_SHM_MAGIC || h->version != GLUE_SHM_VERSION)
+	return 1;
+
+    while (previous != N_FRAMES) {
+	if (g_get_monotonic_time() > deadline)
+	    return 2;
+	sequence = read_frame(h, pixels, &width, &height);
+	if (sequence == 0 || sequence == previous)
+	    continue;
+	if (sequence < previous)
+	    return 1;
+	for (i = 0; i < width * height; i++) {
+	    if (pixels[i] != sequence)
+		return 1;
+	}
+	previous = sequence;
+    }
+    return 0;
+}
+
+static void test_shm_two_processes(void)
+{
+    GlueShm shm;
+    pixman_region32_t damage;
+    pixman_region32_t *pending;
+    uint32_t *pixels, sequence;
+    int i, status;
+    pid_t reader;
+
+    glue_shm_init(&shm);
+    g_assert_true(glue_shm_create(&shm, WIDTH, HEIGHT));
+
+    reader = fork();
+    g_assert_cmpint(reader, !=, -1);
+    if (reader == 0)
+	_exit(run_reader(&shm));
+
+    pixman_region32_init(&damage);
+    for (sequence = 1; sequence <= N_FRAMES; sequence++) {
+	/* Halfway, the frames shrink */
+	int32_t width = sequence <= N_FRAMES / 2 ? WIDTH : WIDTH / 2;
+	int32_t height = sequence <= N_FRAMES / 2 ? HEIGHT : HEIGHT / 2;
+
+	g_assert_true(glue_shm_resize(&shm, width, height));
+	pixels = glue_shm_begin_frame(&shm, &pending);
+	for (i = 0; i < width * height; i++)
+	    pixels[i] = sequence;
+	pixman_region32_clear(pending);
+	pixman_region32_reset(&damage, &(pixman_box32_t){ 0, 0, width, height });
+	glue_shm_publish(&shm, &damage, sequence, GLUE_DISPLAY_ORIGIN_TOP_LEFT);
+	if (sequence % 16 == 0)
+	    g_usleep(100);
+    }
+    pixman_region32_fini(&damage);
+
+    g_assert_cmpint(waitpid(reader, &status, 0), ==, reader);
+    g_assert_true(WIFEXITED(status));
+    g_assert_cmpint(WEXITSTATUS(status), ==, 0);
+
+    glue_shm_clear(&shm);
+}
+
+/* The damage of each frame is in its ring entry, whole frame after a resize */
+static void test_shm_frame_info(void)
+{
+    GlueShm shm;
+    pixman_region32_t damage;
+    pixman_region32_t *pending;
+    const GlueShmFrameInfo *info;
+
+    glue_shm_init(&shm);
+    g_assert_true(glue_shm_create(&shm, WIDTH, HEIGHT));
+    pixman_region32_init_rect(&damage, 8, 4, 16, 2);
+
+    g_assert_true(glue_shm_resize(&shm, WIDTH, HEIGHT));
+    glue_shm_begin_frame(&shm, &pending);
+    pixman_region32_clear(pending);
+    glue_shm_publish(&shm, &damage, 1, GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT);
+    info = &shm.header->frames[1];
+    g_assert_cmpuint(info->sequence, ==, 1);
+    g_assert_cmpuint(info->n_rects, ==, 0);
+
+    glue_shm_begin_frame(&shm, &pending);
+    pixman_region32_clear(pending);
+    glue_shm_publish(&shm, &damage, 2, GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT);
+    info = &shm.header->frames[2];
+    g_assert_cmpuint(shm.header->latest, ==, 2);
+    g_assert_cmpuint(shm.header->origin, ==, GLUE_DISPLAY_ORIGIN_BOTTOM_LEFT);
+    g_assert_cmpuint(info->n_rects, ==, 1);
+    g_assert_cmpint(info->rects[0].x, ==, 8);
+    g_assert_cmpint(info->rects[0].y, ==, HEIGHT - 6);
+    g_assert_cmpint(info->rects[0].width, ==, 16);
+    g_assert_cmpint(info->rects[0].height, ==, 2);
+    /* The slot of the first frame still misses the damage of the second */
+    g_assert_true(pixman_region32_contains_point(&shm.pending[0], 8, 4, NULL));
+
+    pixman_region32_fini(&damage);
+    glue_shm_clear(&shm);
+}
+
+/* A reader that copies the rects of a frame while the ring wraps around
+ * finds another sequence in the entry when it checks it again */
+static void test_shm_ring_wrap(void)
+{
+    GlueShm shm;
+    pixman_region32_t damage;
+    pixman_region32_t *pending;
+    const GlueShmFrameInfo *info;
+    MonoGlueRect rects[GLUE_MAX_DIRTY_RECTS];
+    uint32_t sequence;
+
+    glue_shm_init(&shm);
+    g_assert_true(glue_shm_create(&shm, WIDTH, HEIGHT));
+    g_assert_true(glue_shm_resize(&shm, WIDTH, HEIGHT));
+    pixman_region32_init_rect(&damage, 0, 0, 8, 8);
+
+    glue_shm_begin_frame(&shm, &pending);
+    glue_shm_publish(&shm, &damage, 1, GLUE_DISPLAY_ORIGIN_TOP_LEFT);
+    info = &shm.header->frames[g_atomic_int_get((gint *)&shm.header->latest) % GLUE_SHM_RING_SIZE];
+    g_assert_cmpuint(info->sequence, ==, 1);
+    memcpy(rects, info->rects, sizeof(rects));
+
+    for (sequence = 2; sequence <= GLUE_SHM_RING_SIZE + 1; sequence++) {
+	pixman_region32_reset(&damage, &(pixman_box32_t){ 0, 0, sequence, sequence });
+	glue_shm_begin_frame(&shm, &pending);
+	glue_shm_publish(&shm, &damage, sequence, GLUE_DISPLAY_ORIGIN_TOP_LEFT);
+    }
+    g_assert_cmpuint(g_atomic_int_get((gint *)&info->sequence), !=, 1);
+    g_assert_cmpint(info->rects[0].width, !=, rects[0].width);
+
+    pixman_region32_fini(&damage);
+    glue_shm_clear(&shm);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+#ifdef WIN32
+    /* Shared memory frames are not supported on Windows */
+    return 77;
+#else
+    g_test_add_func("/shm/two-processes", test_shm_two_processes);
+    g_test_add_func("/shm/frame-info", test_shm_frame_info);
+    g_test_add_func("/shm/ring-wrap", test_shm_ring_wrap);
+    return g_test_run();
+#endif
+}
@@ -0,0 +1,164 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Histograms and counters of glue-stats.c, including counters updated
+ * from several threads at once.
+ */
+
+#include <glib.h>
+
+#include "glue-stats.h"
+
+#define N_THREADS 4
+#define EVENTS_PER_THREAD 100000
+
+static void test_histogram_percentiles(void)
+{
+    GlueHistogram h = { { 0 }, 0 };
+    guint32 p50, p99;
+    int i;
+
+    g_assert_cmpuint(glue_histogram_percentile(&h, 50), ==, 0);
+
+    for (i = 1; i <= 1000; i++)
+	glue_histogram_add(&h, i);
+    g_assert_cmpuint(h.count, ==, 1000);
+
+    /* Upper bounds of the buckets, with a resolution of 25% */
+    p50 = glue_histogram_percentile(&h, 50);
+    p99 = glue_histogram_percentile(&h, 99);
+    g_assert_cmpuint(p50, >=, 500);
+    g_assert_cmpuint(p50, <=, 500 * 5 / 4);
+    g_assert_cmpuint(p99, >=, 990);
+    g_assert_cmpuint(p99, <=, 990 * 5 / 4);
+    g_assert_cmpuint(glue_histogram_percentile(&h, 100), >=, 1000);
+}
+
+static void test_histogram_limits(void)
+{
+    GlueHistogram h = { { 0 }, 0 };
+
+    /* Negative and huge times fall in the first and last buckets */
+    glue_histogram_add(&h, -5);
+    g_assert_cmpuint(glue_histogram_percentile(&h, 100), ==, 0);
+    glue_histogram_add(&h, G_MAXINT64);
+    g_assert_cmpuint(glue_histogram_percentile(&h, 100), >=, G_MAXINT32);
+}
+
+static void test_display_counters(void)
+{
+    GlueDisplayStats stats;
+    gint64 now = g_get_monotonic_time();
+
+    glue_stats_reset_display();
+    glue_stats_invalidate();
+    glue_stats_invalidate();
+    glue_stats_frame_published(now - 2000, now, 100, 10, FALSE);
+    glue_stats_frame_published(0, now, 50, 10, TRUE);
+    glue_stats_tiles(8, 3, 3 * 4096);
+    glue_stats_frame_picked_up(now + 1000);
+
+    glue_stats_get_display(&stats);
+    g_assert_cmpuint(stats.invalidations, ==, 2);
+    g_assert_cmpuint(stats.frames_copied, ==, 2);
+    g_assert_cmpuint(stats.frames_skipped, ==, 1);
+    g_assert_cmpuint(stats.pixels_copied, ==, 150);
+    g_assert_cmpuint(stats.tiles_hashed, ==, 8);
+    g_assert_cmpuint(stats.tiles_suppressed, ==, 3);
+    g_assert_cmpuint(stats.bytes_suppressed, ==, 3 * 4096);
+    g_assert_cmpuint(stats.copy_time.count, ==, 2);
+    /* From the first damage of the oldest frame not taken */
+    g_assert_cmpuint(stats.pickup_latency.count, ==, 1);
+    g_assert_cmpuint(stats.pickup_latency.p50, >=, 3000);
+
+    glue_stats_reset_display();
+    glue_stats_get_display(&stats);
+    g_assert_cmpuint(stats.invalidations, ==, 0);
+    g_assert_cmpuint(stats.frames_copied, ==, 0);
+    g_assert_cmpuint(stats.pixels_copied, ==, 0);
+    g_assert_cmpuint(stats.copy_time.count, ==, 0);
+}
+
+static gpointer send_events(gpointer data)
+{
+    int i;
+
+    for (i = 0; i < EVENTS_PER_THREAD; i++) {
+	glue_stats_motion_received();
+	glue_stats_invalidate();
+	if (i % 2 == 0)
+	    glue_stats_motion_sent();
+    }
+    return NULL;
+}
+
+/* Every event counts once, whatever thread records it */
+static void test_concurrent_counters(void)
+{
+    GThread *threads[N_THREADS];
+    GlueDisplayStats display;
+    GlueInputStats input;
+    int i;
+
+    glue_stats_reset_display();
+    glue_stats_reset_input();
+    for (i = 0; i < N_THREADS; i++)
+	threads[i] = g_thread_new("stats", send_events, NULL);
+    for (i = 0; i < N_THREADS; i++)
+	g_thread_join(threads[i]);
+
+    glue_stats_get_display(&display);
+    glue_stats_get_input(&input);
+    g_assert_cmpuint(display.invalidations, ==, N_THREADS * EVENTS_PER_THREAD);
+    g_assert_cmpuint(input.motion_received, ==, N_THREADS * EVENTS_PER_THREAD);
+    g_assert_cmpuint(input.motion_sent, ==, N_THREADS * EVENTS_PER_THREAD / 2);
+}
+
+static void test_input_counters(void)
+{
+    GlueInputStats stats;
+    gint64 now = g_get_monotonic_time();
+
+    glue_stats_reset_input();
+    glue_stats_input_dropped();
+    glue_stats_input_sent(now - 500, now);
+
+    glue_stats_get_input(&stats);
+    g_assert_cmpuint(stats.input_dropped, ==, 1);
+    g_assert_cmpuint(stats.input_to_send.count, ==, 1);
+    g_assert_cmpuint(stats.input_to_send.p50, >=, 500);
+
+    glue_stats_reset_input();
+    glue_stats_get_input(&stats);
+    g_assert_cmpuint(stats.input_dropped, ==, 0);
+    g_assert_cmpuint(stats.input_to_send.count, ==, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    glue_stats_init();
+
+    g_test_add_func("/stats/histogram/percentiles", test_histogram_percentiles);
+    g_test_add_func("/stats/histogram/limits", test_histogram_limits);
+    g_test_add_func("/stats/display/counters", test_display_counters);
+    g_test_add_func("/stats/input/counters", test_input_counters);
+    g_test_add_func("/stats/concurrent", test_concurrent_counters);
+
+    return g_test_run();
+}
@@ -0,0 +1,152 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Connection timeline of glue-timeline.c: the steps and channels of a
+ * connection, in the order they happen.
+ */
+
+#include <glib.h>
+#include "spice-client.h"
+
+#include "glue-timeline.h"
+
+/* Long enough for the monotonic clock to move */
+#define PAUSE 1000
+
+static void test_timeline_before_start(void)
+{
+    GlueTimeline timeline;
+    MonoGlueConnectTimeline steps;
+
+    glue_timeline_init(&timeline);
+    glue_timeline_step(&timeline, GLUE_CONNECT_SESSION_SETUP);
+    glue_timeline_channel_new(&timeline, SPICE_CHANNEL_MAIN, 0);
+    glue_timeline_get(&timeline, &steps);
+    g_assert_cmpint(steps.started, ==, 0);
+    g_assert_cmpint(steps.steps[GLUE_CONNECT_SESSION_SETUP], ==, -1);
+    g_assert_cmpint(steps.n_channels, ==, 0);
+    glue_timeline_clear(&timeline);
+}
+
+static void test_timeline_steps(void)
+{
+    GlueTimeline timeline;
+    MonoGlueConnectTimeline steps;
+    gint64 main_init;
+
+    glue_timeline_init(&timeline);
+    glue_timeline_start(&timeline);
+    glue_timeline_step(&timeline, GLUE_CONNECT_SESSION_SETUP);
+    g_usleep(PAUSE);
+    glue_timeline_step(&timeline, GLUE_CONNECT_MAIN_INIT);
+    g_usleep(PAUSE);
+    glue_timeline_step(&timeline, GLUE_CONNECT_PRIMARY_CREATE);
+
+    glue_timeline_get(&timeline, &steps);
+    g_assert_cmpint(steps.started, >, 0);
+    g_assert_cmpint(steps.steps[GLUE_CONNECT_SESSION_SETUP], >=, 0);
+    g_assert_cmpint(steps.steps[GLUE_CONNECT_MAIN_INIT], >,
+		    steps.steps[GLUE_CONNECT_SESSION_SETUP]);
+    g_assert_cmpint(steps.steps[GLUE_CONNECT_PRIMARY_CREATE], >,
+		    steps.steps[GLUE_CONNECT_MAIN_INIT]);
+    g_assert_cmpint(steps.steps[GLUE_CONNECT_DISPLAY_MARK], ==, -1);
+    g_assert_cmpint(steps.steps[GLUE_CONNECT_FIRST_FRAME], ==, -1);
+
+    /* A step that happens again keeps its first time */
+    main_init = steps.steps[GLUE_CONNECT_MAIN_INIT];
+    g_usleep(PAUSE);
+    glue_timeline_step(&timeline, GLUE_CONNECT_MAIN_INIT);
+    glue_timeline_get(&timeline, &steps);
+    g_assert_cmpint(steps.steps[GLUE_CONNECT_MAIN_INIT], ==, main_init);
+
+    glue_timeline_clear(&timeline);
+}
+
+static void test_timeline_channels(void)
+{
+    GlueTimeline timeline;
+    MonoGlueConnectTimeline steps;
+
+    glue_timeline_init(&timeline);
+    glue_timeline_start(&timeline);
+    glue_timeline_channel_new(&timeline, SPICE_CHANNEL_MAIN, 0);
+    g_usleep(PAUSE);
+    glue_timeline_channel_new(&timeline, SPICE_CHANNEL_DISPLAY, 0);
+    glue_timeline_channel_new(&timeline, SPICE_CHANNEL_MAIN, 0);
+    g_usleep(PAUSE);
+    glue_timeline_channel_event(&timeline, SPICE_CHANNEL_MAIN, 0, SPICE_CHANNEL_OPENED);
+    glue_timeline_channel_event(&timeline, SPICE_CHANNEL_DISPLAY, 0, SPICE_CHANNEL_ERROR_TLS);
+    glue_timeline_channel_event(&timeline, SPICE_CHANNEL_DISPLAY, 0, SPICE_CHANNEL_ERROR_IO);
+    /* Not created in this connection */
+    glue_timeline_channel_event(&timeline, SPICE_CHANNEL_INPUTS, 0, SPICE_CHANNEL_OPENED);
+
+    glue_timeline_get(&timeline, &steps);
+    g_assert_cmpint(steps.n_channels, ==, 2);
+    g_assert_cmpint(steps.channels[0].type, ==, SPICE_CHANNEL_MAIN);
+    g_assert_cmpint(steps.channels[1].type, ==, SPICE_CHANNEL_DISPLAY);
+    g_assert_cmpint(steps.channels[1].created, >, steps.channels[0].created);
+    g_assert_cmpint(steps.channels[0].opened, >, steps.channels[1].created);
+    g_assert_cmpint(steps.channels[0].error, ==, 0);
+    g_assert_cmpint(steps.channels[1].opened, ==, -1);
+    g_assert_cmpint(steps.channels[1].error, ==, SPICE_CHANNEL_ERROR_TLS);
+
+    glue_timeline_clear(&timeline);
+}
+
+/* A new connection forgets the steps and channels of the previous one */
+static void test_timeline_restart(void)
+{
+    GlueTimeline timeline;
+    MonoGlueConnectTimeline steps;
+    gint64 first_start;
+    int i;
+
+    glue_timeline_init(&timeline);
+    glue_timeline_start(&timeline);
+    for (i = 0; i < GLUE_CONNECT_STEPS; i++)
+	glue_timeline_step(&timeline, i);
+    glue_timeline_channel_new(&timeline, SPICE_CHANNEL_MAIN, 0);
+    glue_timeline_get(&timeline, &steps);
+    first_start = steps.started;
+
+    g_usleep(PAUSE);
+    glue_timeline_start(&timeline);
+    glue_timeline_get(&timeline, &steps);
+    g_assert_cmpint(steps.started, >, first_start);
+    for (i = 0; i < GLUE_CONNECT_STEPS; i++)
+	g_assert_cmpint(steps.steps[i], ==, -1);
+    g_assert_cmpint(steps.n_channels, ==, 0);
+
+    glue_timeline_step(&timeline, GLUE_CONNECT_SESSION_SETUP);
+    glue_timeline_get(&timeline, &steps);
+    g_assert_cmpint(steps.steps[GLUE_CONNECT_SESSION_SETUP], >=, 0);
+
+    glue_timeline_clear(&timeline);
+}
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/timeline/before-start", test_timeline_before_start);
+    g_test_add_func("/timeline/steps", test_timeline_steps);
+    g_test_add_func("/timeline/channels", test_timeline_channels);
+    g_test_add_func("/timeline/restart", test_timeline_restart);
+
+    return g_test_run();
+}
@@ -0,0 +1,163 @@
+/**
+ * Copyright (C) 2016 flexVDI (Flexible Software Solutions S.L.)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Input traces of glue-stats.c, replaying scripted sessions: the input
+ * events of the host, the damage sent by the server and the frames
+ * published by the glue, each one at a fixed time. The calls are the ones
+ * that motion_event() and key_event(), invalidate() and publish_frame()
+ * make in the widget, which needs a display channel to run; the script
+ * stands in for them and for the clock.
+ */
+
+#include <glib.h>
+
+#include "glue-stats.h"
+
+/* Any time but 0, which means no trace */
+#define START G_USEC_PER_SEC
+#define MSEC  1000
+
+typedef enum {
+    MOTION,
+    KEY,
+    DAMAGE,
+    PUBLISH,
+    END
+} StepKind;
+
+typedef struct {
+    gint64   time;
+    StepKind kind;
+    gint     x, y, width, height;
+} Step;
+
+static void replay(const Step *steps)
+{
+    GlueInputTrace trace = { 0 };
+
+    glue_stats_reset_input();
+    for (; steps->kind != END; steps++) {
+	gint64 now = START + steps->time;
+
+	switch (steps->kind) {
+	case MOTION:
+	    glue_trace_input(&trace, now, TRUE, steps->x, steps->y);
+	    break;
+	case KEY:
+	    glue_trace_input(&trace, now, FALSE, 0, 0);
+	    break;
+	case DAMAGE:
+	    glue_trace_damage(&trace, now, steps->x, steps->y, steps->width, steps->height);
+	    break;
+	case PUBLISH:
+	    glue_trace_frame_published(&trace, now);
+	    break;
+	default:
+	    break;
+	}
+    }
+}
+
+/* Checks a histogram with a single sample */
+static void assert_single(const MonoGluePercentiles *p, gint64 usecs)
+{
+    g_assert_cmpuint(p->count, ==, 1);
+    g_assert_cmpuint(p->p50, >=, usecs);
+    g_assert_cmpuint(p->p50, <=, usecs * 5 / 4);
+}
+
+/* In client mode, motion draws no damage: each event replaces the last one
+ * without a response, so the key press is measured when it comes */
+static void test_trace_client_motion(void)
+{
+    Step steps[128];
+    GlueInputStats stats;
+    int i, n = 0;
+
+    for (i = 0; i < 50; i++) {
+	steps[n++] = (Step){ i * 10 * MSEC, MOTION, 100 + i, 100 };
+	if (i % 2)
+	    steps[n++] = (Step){ i * 10 * MSEC + 5 * MSEC, PUBLISH };
+    }
+    steps[n++] = (Step){ 600 * MSEC, KEY };
+    steps[n++] = (Step){ 620 * MSEC, DAMAGE, 0, 0, 16, 16 };
+    steps[n++] = (Step){ 630 * MSEC, PUBLISH };
+    steps[n++] = (Step){ 0, END };
+    g_assert_cmpuint(n, <=, G_N_ELEMENTS(steps));
+    replay(steps);
+
+    glue_stats_get_input(&stats);
+    assert_single(&stats.input_to_damage, 20 * MSEC);
+    assert_single(&stats.input_to_frame, 30 * MSEC);
+    g_assert_cmpuint(stats.traces_expired, ==, 0);
+}
+
+/* In server mode, only the damage around the pointer is the response, and
+ * the events that follow wait until it is published */
+static void test_trace_server_motion(void)
+{
+    static const Step steps[] = {
+	{ 0,         MOTION,  200, 200 },
+	{ 4 * MSEC,  DAMAGE,  600, 400, 32, 32 },
+	{ 6 * MSEC,  PUBLISH },
+	{ 8 * MSEC,  DAMAGE,  190, 190, 32, 32 },
+	{ 9 * MSEC,  MOTION,  210, 200 },
+	{ 12 * MSEC, DAMAGE,  200, 190, 32, 32 },
+	{ 16 * MSEC, PUBLISH },
+	{ 0, END }
+    };
+    GlueInputStats stats;
+
+    replay(steps);
+    glue_stats_get_input(&stats);
+    assert_single(&stats.input_to_damage, 8 * MSEC);
+    assert_single(&stats.input_to_frame, 16 * MSEC);
+    g_assert_cmpuint(stats.traces_expired, ==, 0);
+}
+
+/* A trace without response is dropped by the first frame after the timeout */
+static void test_trace_timeout(void)
+{
+    static const Step steps[] = {
+	{ 0,                                    KEY },
+	{ GLUE_INPUT_TRACE_TIMEOUT / 2,         PUBLISH },
+	{ GLUE_INPUT_TRACE_TIMEOUT + MSEC,      PUBLISH },
+	{ GLUE_INPUT_TRACE_TIMEOUT + 2 * MSEC,  DAMAGE, 0, 0, 16, 16 },
+	{ GLUE_INPUT_TRACE_TIMEOUT + 3 * MSEC,  PUBLISH },
+	{ 0, END }
+    };
+    GlueInputStats stats;
+
+    replay(steps);
+    glue_stats_get_input(&stats);
+    g_assert_cmpuint(stats.traces_expired, ==, 1);
+    g_assert_cmpuint(stats.input_to_damage.count, ==, 0);
+    g_assert_cmpuint(stats.input_to_frame.count, ==, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    glue_stats_init();
+
+    g_test_add_func("/trace/client-motion", test_trace_client_motion);
+    g_test_add_func("/trace/server-motion", test_trace_server_motion);
+    g_test_add_func("/trace/timeout", test_trace_timeout);
+
+    return g_test_run();
+}